@@ -0,0 +1,92 @@
+/* records.c
+
+   Writes many small fixed-size records to a file, each made of a
+   key field and a value field, either with one write() per field
+   or with one writev() per group of records, then checks a few
+   of them with pread().  Compare the timer ticks that the kernel
+   prints at shutdown for "records write" and "records writev". */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+#define RECORD_CNT 2048                 /* Records to write. */
+#define KEY_SIZE 4                      /* Bytes in a key field. */
+#define VALUE_SIZE 12                   /* Bytes in a value field. */
+#define RECORD_SIZE (KEY_SIZE + VALUE_SIZE)
+#define GROUP_CNT (IOV_MAX / 2)         /* Records per writev(). */
+
+static char keys[RECORD_CNT][KEY_SIZE];
+static char values[RECORD_CNT][VALUE_SIZE];
+
+int
+main (int argc, char *argv[]) 
+{
+  bool vectored;
+  int fd, i;
+
+  if (argc != 2
+      || (strcmp (argv[1], "write") && strcmp (argv[1], "writev")))
+    {
+      printf ("usage: records write|writev\n");
+      return EXIT_FAILURE;
+    }
+  vectored = !strcmp (argv[1], "writev");
+
+  for (i = 0; i < RECORD_CNT; i++)
+    {
+      snprintf (keys[i], KEY_SIZE, "%03x", i % 0x1000);
+      snprintf (values[i], VALUE_SIZE, "value %5d", i);
+    }
+
+  if (!create ("records", RECORD_CNT * RECORD_SIZE))
+    {
+      printf ("records: create failed\n");
+      return EXIT_FAILURE;
+    }
+  fd = open ("records");
+  if (fd < 0)
+    {
+      printf ("records: open failed\n");
+      return EXIT_FAILURE;
+    }
+
+  if (vectored)
+    for (i = 0; i < RECORD_CNT; i += GROUP_CNT)
+      {
+        struct iovec iov[IOV_MAX];
+        int j;
+
+        for (j = 0; j < GROUP_CNT; j++)
+          {
+            iov[2 * j].iov_base = keys[i + j];
+            iov[2 * j].iov_len = KEY_SIZE;
+            iov[2 * j + 1].iov_base = values[i + j];
+            iov[2 * j + 1].iov_len = VALUE_SIZE;
+          }
+        writev (fd, iov, 2 * GROUP_CNT);
+      }
+  else
+    for (i = 0; i < RECORD_CNT; i++)
+      {
+        write (fd, keys[i], KEY_SIZE);
+        write (fd, values[i], VALUE_SIZE);
+      }
+
+  for (i = 0; i < RECORD_CNT; i += RECORD_CNT / 8)
+    {
+      char record[RECORD_SIZE];
+
+      if (pread (fd, record, RECORD_SIZE, i * RECORD_SIZE) != RECORD_SIZE
+          || memcmp (record, keys[i], KEY_SIZE)
+          || memcmp (record + KEY_SIZE, values[i], VALUE_SIZE))
+        {
+          printf ("records: record %d is wrong\n", i);
+          return EXIT_FAILURE;
+        }
+    }
+  close (fd);
+
+  printf ("records: wrote %d records with %s\n", RECORD_CNT, argv[1]);
+  return EXIT_SUCCESS;
+}
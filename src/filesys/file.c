@@ -105,6 +105,15 @@ file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Like file_write_at(), but returns -1 without writing anything
+   if FILE's inode is being written, instead of waiting. */
+off_t
+file_try_write_at (struct file *file, const void *buffer, off_t size,
+                   off_t file_ofs)
+{
+  return inode_try_write_at (file->inode, buffer, size, file_ofs);
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
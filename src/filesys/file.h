@@ -1,7 +1,7 @@
 #ifndef FILESYS_FILE_H
 #define FILESYS_FILE_H
 
-#include <list.h>
+#include <stdbool.h>
 #include "filesys/off_t.h"
 
 struct inode;
@@ -13,12 +13,6 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
-
-#ifdef USERPROG
-    /* Shared between userprog/process.c and userprog/syscall.c. */
-    int fd;                     /* A file descriptor. */
-    struct list_elem elem;      /* List element. */
-#endif
   };
 
 /* Opening and closing files. */
@@ -32,6 +26,8 @@ off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
+off_t file_try_write_at (struct file *, const void *, off_t size,
+                         off_t start);
 
 /* Preventing writes. */
 void file_deny_write (struct file *);
@@ -6,6 +6,9 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/memprof.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -28,14 +31,20 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
+/* Maximum number of closed inodes kept in memory. */
+#define INODE_CACHE_MAX 32
+
 /* In-memory inode. */
 struct inode 
   {
     struct list_elem elem;              /* Element in inode list. */
+    struct list_elem lru_elem;          /* Element in closed_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct lock lock;                   /* Protects deny_write_cnt. */
+    struct lock dir_lock;               /* Serializes directory changes. */
     struct inode_disk data;             /* Inode content. */
   };
 
@@ -53,15 +62,59 @@ byte_to_sector (const struct inode *inode, off_t pos)
     return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
+/* List of in-memory inodes, so that opening a single inode twice
+   returns the same `struct inode'.
+
+   When the last opener of an inode closes it, the inode stays on
+   this list, with an open_cnt of 0, and also goes on the front
+   of closed_inodes, so that reopening it soon does not have to
+   read it from disk again.  At most INODE_CACHE_MAX closed inodes
+   are kept; beyond that, and whenever the page allocator asks
+   inode_shrinker for memory, the least recently closed ones are
+   freed.  Removed inodes are never kept. */
 static struct list open_inodes;
+static struct list closed_inodes;
+static size_t closed_cnt;
+
+/* Protects the lists above and the open counts and removed flags
+   of inodes.
+
+   Each inode's own lock serializes writes to it, so that two
+   writers of parts of one sector do not undo each other, and
+   makes the check for denied writes agree with
+   inode_deny_write().  Reads take no lock: a file's length and
+   sectors never change while it is open, and a read that races
+   a write sees each sector either before or after.  Different
+   files, and readers of one file, can therefore do I/O at the
+   same time.  A writer may fault on a user buffer and need to
+   evict a page; eviction only tries to write a mapped page back,
+   with inode_try_write_at().
+
+   directory.c holds a directory's dir_lock across each lookup,
+   addition and removal. */
+static struct lock inodes_lock;
+
+static struct shrinker inode_shrinker;
+
+static struct inode *find_inode (block_sector_t);
+static void evict_inode (void);
+static off_t write_at (struct inode *, const void *, off_t size,
+                       off_t offset);
+static size_t inode_cache_count (void);
+static size_t inode_cache_shrink (size_t cnt);
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
   list_init (&open_inodes);
+  list_init (&closed_inodes);
+  lock_init (&inodes_lock);
+
+  inode_shrinker.name = "inode";
+  inode_shrinker.count = inode_cache_count;
+  inode_shrinker.shrink = inode_cache_shrink;
+  palloc_register_shrinker (&inode_shrinker);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -107,24 +160,24 @@ inode_create (block_sector_t sector, off_t length)
 
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
-   Returns a null pointer if memory allocation fails. */
+   Returns a null pointer if memory allocation fails.
+
+   The inode is read from disk without holding inodes_lock, so
+   that opening one file does not hold up opening and closing
+   others.  Another thread may open the same inode meanwhile, so
+   we look again before adding ours, and use theirs if they got
+   there first. */
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
-  struct inode *inode;
+  struct inode *inode, *other;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
-    {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
-    }
+  /* Check whether this inode is already in memory. */
+  lock_acquire (&inodes_lock);
+  inode = find_inode (sector);
+  lock_release (&inodes_lock);
+  if (inode != NULL)
+    return inode;
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
@@ -132,12 +185,25 @@ inode_open (block_sector_t sector)
     return NULL;
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
+  lock_init (&inode->lock);
+  lock_init (&inode->dir_lock);
   block_read (fs_device, inode->sector, &inode->data);
+
+  lock_acquire (&inodes_lock);
+  other = find_inode (sector);
+  if (other == NULL)
+    list_push_front (&open_inodes, &inode->elem);
+  lock_release (&inodes_lock);
+
+  if (other != NULL)
+    {
+      free (inode);
+      return other;
+    }
   return inode;
 }
 
@@ -146,7 +212,13 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&inodes_lock);
+      ASSERT (inode->open_cnt > 0);
+      inode->open_cnt++;
+      lock_release (&inodes_lock);
+      memprof_disown (inode);
+    }
   return inode;
 }
 
@@ -158,8 +230,10 @@ inode_get_inumber (const struct inode *inode)
 }
 
 /* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If this was the last reference to INODE, keeps it in memory
+   for a while in case it is reopened soon.
+   If INODE was also a removed inode, frees its memory and its
+   blocks instead. */
 void
 inode_close (struct inode *inode) 
 {
@@ -167,22 +241,109 @@ inode_close (struct inode *inode)
   if (inode == NULL)
     return;
 
+  lock_acquire (&inodes_lock);
+
   /* Release resources if this was the last opener. */
   if (--inode->open_cnt == 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
+          /* Remove from inode list and release lock. */
+          list_remove (&inode->elem);
+          lock_release (&inodes_lock);
+
+          /* Deallocate blocks. */
           free_map_release (inode->sector, 1);
           free_map_release (inode->data.start,
                             bytes_to_sectors (inode->data.length)); 
+          free (inode); 
+          return;
+        }
+
+      /* Keep it cached, making room if necessary.  The cache,
+         not the thread that opened it, owns it now. */
+      memprof_disown (inode);
+      list_push_front (&closed_inodes, &inode->lru_elem);
+      if (++closed_cnt > INODE_CACHE_MAX)
+        evict_inode ();
+    }
+
+  lock_release (&inodes_lock);
+}
+
+/* Returns the in-memory inode for SECTOR, opened once more, or
+   a null pointer if it is not in memory.  inodes_lock must be
+   held.  The inode is now shared with whoever opened it first,
+   so it is disowned for the memory profiler. */
+static struct inode *
+find_inode (block_sector_t sector)
+{
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&inodes_lock));
+
+  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
+       e = list_next (e)) 
+    {
+      struct inode *inode = list_entry (e, struct inode, elem);
+      if (inode->sector == sector) 
+        {
+          if (inode->open_cnt++ == 0)
+            {
+              list_remove (&inode->lru_elem);
+              closed_cnt--;
+            }
+          memprof_disown (inode);
+          return inode; 
         }
+    }
+  return NULL;
+}
+
+/* Frees the least recently closed inode.
+   inodes_lock must be held. */
+static void
+evict_inode (void)
+{
+  struct inode *inode;
+
+  ASSERT (lock_held_by_current_thread (&inodes_lock));
+  ASSERT (closed_cnt > 0);
+
+  inode = list_entry (list_pop_back (&closed_inodes), struct inode,
+                      lru_elem);
+  ASSERT (inode->open_cnt == 0 && !inode->removed);
+  list_remove (&inode->elem);
+  closed_cnt--;
+  free (inode);
+}
+
+/* Returns the number of closed inodes kept in memory. */
+static size_t
+inode_cache_count (void)
+{
+  return closed_cnt;
+}
 
-      free (inode); 
+/* Frees up to CNT closed inodes and returns the number freed.
+   Called by the page allocator when it is short of memory, in
+   which case the current thread may already hold inodes_lock or
+   another thread may be using it, and then we don't touch it. */
+static size_t
+inode_cache_shrink (size_t cnt)
+{
+  size_t freed = 0;
+
+  if (lock_held_by_current_thread (&inodes_lock)
+      || !lock_try_acquire (&inodes_lock))
+    return 0;
+  while (freed < cnt && closed_cnt > 0)
+    {
+      evict_inode ();
+      freed++;
     }
+  lock_release (&inodes_lock);
+  return freed;
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -191,7 +352,10 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+
+  lock_acquire (&inodes_lock);
   inode->removed = true;
+  lock_release (&inodes_lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -255,13 +419,48 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
    (Normally a write at end of file would extend the inode, but
    growth is not yet implemented.) */
 off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
                 off_t offset) 
+{
+  off_t bytes_written;
+
+  lock_acquire (&inode->lock);
+  bytes_written = write_at (inode, buffer, size, offset);
+  lock_release (&inode->lock);
+
+  return bytes_written;
+}
+
+/* Like inode_write_at(), but returns -1 without writing anything
+   if INODE is being written, by this thread or another, instead
+   of waiting. */
+off_t
+inode_try_write_at (struct inode *inode, const void *buffer, off_t size,
+                    off_t offset) 
+{
+  off_t bytes_written;
+
+  if (lock_held_by_current_thread (&inode->lock)
+      || !lock_try_acquire (&inode->lock))
+    return -1;
+  bytes_written = write_at (inode, buffer, size, offset);
+  lock_release (&inode->lock);
+
+  return bytes_written;
+}
+
+/* Does the work of inode_write_at().  INODE's lock must be
+   held. */
+static off_t
+write_at (struct inode *inode, const void *buffer_, off_t size,
+          off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
   uint8_t *bounce = NULL;
 
+  ASSERT (lock_held_by_current_thread (&inode->lock));
+
   if (inode->deny_write_cnt)
     return 0;
 
@@ -322,8 +521,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&inode->lock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,9 +533,11 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  lock_release (&inode->lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -343,3 +546,18 @@ inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Acquires directory INODE's lock, to look up, add or remove an
+   entry without interference. */
+void
+inode_dir_lock (struct inode *inode)
+{
+  lock_acquire (&inode->dir_lock);
+}
+
+/* Releases directory INODE's lock. */
+void
+inode_dir_unlock (struct inode *inode)
+{
+  lock_release (&inode->dir_lock);
+}
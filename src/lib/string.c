@@ -1,5 +1,24 @@
 #include <string.h>
 #include <debug.h>
+#include <stdint.h>
+
+/* memcpy(), memmove(), memset(), and memcmp() work a 32-bit word
+   at a time once the block is big enough to be worth it, after
+   going a byte at a time up to a word boundary in the
+   destination, and finish any leftover bytes one at a time.
+   x86 allows unaligned word loads and stores, so only one side
+   is aligned.  Blocks of REP_MIN bytes or more are copied and
+   filled with the x86 string instructions, which are fastest
+   for large blocks but slow to start.  strlen() looks for the
+   null terminator a word at a time, which never reads past the
+   end of the word, and thus the page, that holds it. */
+
+/* A word, which may alias any other type. */
+typedef uint32_t word_t __attribute__ ((__may_alias__));
+#define WORD_SIZE sizeof (word_t)
+
+/* Smallest block for "rep movsl" and "rep stosl". */
+#define REP_MIN 64
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -12,6 +31,27 @@ memcpy (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
+  if (size >= 2 * WORD_SIZE)
+    {
+      while ((uintptr_t) dst % WORD_SIZE != 0)
+        {
+          *dst++ = *src++;
+          size--;
+        }
+      if (size >= REP_MIN)
+        {
+          size_t cnt = size / WORD_SIZE;
+          asm volatile ("rep movsl"
+                        : "+D" (dst), "+S" (src), "+c" (cnt) : : "memory");
+          size %= WORD_SIZE;
+        }
+      for (; size >= WORD_SIZE; size -= WORD_SIZE)
+        {
+          *(word_t *) dst = *(const word_t *) src;
+          dst += WORD_SIZE;
+          src += WORD_SIZE;
+        }
+    }
   while (size-- > 0)
     *dst++ = *src++;
 
@@ -29,20 +69,32 @@ memmove (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  if (dst < src) 
-    {
-      while (size-- > 0)
-        *dst++ = *src++;
-    }
-  else 
+  /* memcpy() copies forward, reading each word before writing
+     it, which is safe if DST precedes SRC. */
+  if (dst <= src || dst >= src + size)
+    return memcpy (dst_, src_, size);
+
+  /* Copy backward. */
+  dst += size;
+  src += size;
+  if (size >= 2 * WORD_SIZE)
     {
-      dst += size;
-      src += size;
-      while (size-- > 0)
-        *--dst = *--src;
+      while ((uintptr_t) dst % WORD_SIZE != 0)
+        {
+          *--dst = *--src;
+          size--;
+        }
+      for (; size >= WORD_SIZE; size -= WORD_SIZE)
+        {
+          dst -= WORD_SIZE;
+          src -= WORD_SIZE;
+          *(word_t *) dst = *(const word_t *) src;
+        }
     }
+  while (size-- > 0)
+    *--dst = *--src;
 
-  return dst;
+  return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -58,6 +110,20 @@ memcmp (const void *a_, const void *b_, size_t size)
   ASSERT (a != NULL || size == 0);
   ASSERT (b != NULL || size == 0);
 
+  /* Skip words that are equal.  The bytes that follow find the
+     difference, if any. */
+  if (size >= 2 * WORD_SIZE)
+    {
+      for (; (uintptr_t) a % WORD_SIZE != 0; a++, b++, size--)
+        if (*a != *b)
+          return *a > *b ? +1 : -1;
+      for (; size >= WORD_SIZE && *(const word_t *) a == *(const word_t *) b;
+           size -= WORD_SIZE)
+        {
+          a += WORD_SIZE;
+          b += WORD_SIZE;
+        }
+    }
   for (; size-- > 0; a++, b++)
     if (*a != *b)
       return *a > *b ? +1 : -1;
@@ -281,7 +347,29 @@ memset (void *dst_, int value, size_t size)
   unsigned char *dst = dst_;
 
   ASSERT (dst != NULL || size == 0);
-  
+
+  if (size >= 2 * WORD_SIZE)
+    {
+      word_t word = (unsigned char) value * 0x01010101u;
+
+      while ((uintptr_t) dst % WORD_SIZE != 0)
+        {
+          *dst++ = value;
+          size--;
+        }
+      if (size >= REP_MIN)
+        {
+          size_t cnt = size / WORD_SIZE;
+          asm volatile ("rep stosl"
+                        : "+D" (dst), "+c" (cnt) : "a" (word) : "memory");
+          size %= WORD_SIZE;
+        }
+      for (; size >= WORD_SIZE; size -= WORD_SIZE)
+        {
+          *(word_t *) dst = word;
+          dst += WORD_SIZE;
+        }
+    }
   while (size-- > 0)
     *dst++ = value;
 
@@ -296,8 +384,21 @@ strlen (const char *string)
 
   ASSERT (string != NULL);
 
-  for (p = string; *p != '\0'; p++)
-    continue;
+  for (p = string; (uintptr_t) p % WORD_SIZE != 0; p++)
+    if (*p == '\0')
+      return p - string;
+
+  /* A word has a zero byte if subtracting 1 from each byte
+     borrows out of one that did not already have its top bit
+     set. */
+  for (;; p += WORD_SIZE)
+    {
+      word_t word = *(const word_t *) p;
+      if ((word - 0x01010101u) & ~word & 0x80808080u)
+        break;
+    }
+  while (*p != '\0')
+    p++;
   return p - string;
 }
 
@@ -20,10 +20,18 @@ enum
     SYS_CLOSE,                  /* Close a file. */
     SYS_FIBONACCI,              /* Get n-th value of Fibonacci sequence. */
     SYS_MAXOFFOURINT,           /* Get maximum of four integers. */
+    SYS_READV,                  /* Read from a file into buffers. */
+    SYS_WRITEV,                 /* Write to a file from buffers. */
+    SYS_PREAD,                  /* Read from a file at an offset. */
+    SYS_PWRITE,                 /* Write to a file at an offset. */
 
     /* Project 3 and optionally project 4. */
     SYS_MMAP,                   /* Map a file into memory. */
     SYS_MUNMAP,                 /* Remove a memory mapping. */
+    SYS_FORK,                   /* Clone this process. */
+    SYS_RSSLIMIT,               /* Limit resident pages. */
+    SYS_GETRSS,                 /* Count resident pages. */
+    SYS_GETWSS,                 /* Estimate working set. */
 
     /* Project 4 only. */
     SYS_CHDIR,                  /* Change the current directory. */
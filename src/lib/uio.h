@@ -0,0 +1,19 @@
+#ifndef __LIB_UIO_H
+#define __LIB_UIO_H
+
+/* Buffers for the vectored I/O system calls readv() and
+   writev(), shared by the kernel and user programs. */
+
+#include <stddef.h>
+
+/* One buffer in a list of buffers. */
+struct iovec
+  {
+    void *iov_base;             /* Start of buffer. */
+    size_t iov_len;             /* Length of buffer, in bytes. */
+  };
+
+/* Most buffers that one readv() or writev() accepts. */
+#define IOV_MAX 64
+
+#endif /* lib/uio.h */
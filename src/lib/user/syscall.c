@@ -171,6 +171,30 @@ max_of_four_int (int a, int b, int c, int d)
   return syscall4 (SYS_MAXOFFOURINT, a, b, c, d);
 }
 
+int
+readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int
+pread (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PREAD, fd, buffer, size, offset);
+}
+
+int
+pwrite (int fd, const void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PWRITE, fd, buffer, size, offset);
+}
+
 mapid_t
 mmap (int fd, void *addr)
 {
@@ -183,6 +207,30 @@ munmap (mapid_t mapid)
   syscall1 (SYS_MUNMAP, mapid);
 }
 
+pid_t
+fork (void)
+{
+  return syscall0 (SYS_FORK);
+}
+
+void
+rsslimit (unsigned pages)
+{
+  syscall1 (SYS_RSSLIMIT, pages);
+}
+
+unsigned
+getrss (void)
+{
+  return syscall0 (SYS_GETRSS);
+}
+
+unsigned
+getwss (void)
+{
+  return syscall0 (SYS_GETWSS);
+}
+
 bool
 chdir (const char *dir)
 {
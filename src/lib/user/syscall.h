@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <uio.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -35,10 +36,18 @@ unsigned tell (int fd);
 void close (int fd);
 int fibonacci (int n);
 int max_of_four_int (int a, int b, int c, int d);
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+int pread (int fd, void *buffer, unsigned length, unsigned offset);
+int pwrite (int fd, const void *buffer, unsigned length, unsigned offset);
 
 /* Project 3 and optionally project 4. */
 mapid_t mmap (int fd, void *addr);
 void munmap (mapid_t);
+pid_t fork (void);
+void rsslimit (unsigned pages);
+unsigned getrss (void);
+unsigned getwss (void);
 
 /* Project 4 only. */
 bool chdir (const char *dir);
@@ -0,0 +1,115 @@
+/* Times malloc() and free() and prints the timer ticks that
+   PAIR_CNT allocate-and-free pairs took, for each of several
+   block sizes, first in one thread and then in THREAD_CNT
+   threads at once.  Blocks of up to 512 bytes are served from
+   per-thread magazines, so the 1024-byte timing shows the cost
+   of going to the shared descriptor every time.  The "lookup"
+   pattern allocates and frees the blocks that opening a
+   directory and looking up a name in it needs: a struct dir, a
+   name buffer, and a directory entry.  The timings vary from
+   run to run, so only their presence is checked. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define PAIR_CNT 100000         /* Pairs per timing. */
+#define THREAD_CNT 4            /* Threads in the concurrent run. */
+#define LOOKUP 0                /* Size that stands for "lookup". */
+
+static const size_t sizes[] = {16, 64, 256, 512, 1024, LOOKUP};
+#define SIZE_CNT (sizeof sizes / sizeof *sizes)
+
+struct worker
+  {
+    size_t size;                /* Block size to allocate. */
+    struct semaphore done;      /* Upped when finished. */
+  };
+
+static thread_func worker_thread;
+static void run_pairs (size_t size);
+static void print_timing (size_t size, int thread_cnt, int64_t ticks);
+
+void
+test_malloc_bench (void)
+{
+  static struct worker workers[THREAD_CNT];
+  size_t i;
+  int j;
+
+  for (i = 0; i < SIZE_CNT; i++)
+    {
+      int64_t start = timer_ticks ();
+      run_pairs (sizes[i]);
+      print_timing (sizes[i], 1, timer_elapsed (start));
+    }
+
+  for (i = 0; i < SIZE_CNT; i++)
+    {
+      int64_t start = timer_ticks ();
+
+      for (j = 0; j < THREAD_CNT; j++)
+        {
+          workers[j].size = sizes[i];
+          sema_init (&workers[j].done, 0);
+          thread_create ("bench", PRI_DEFAULT, worker_thread, &workers[j]);
+        }
+      for (j = 0; j < THREAD_CNT; j++)
+        sema_down (&workers[j].done);
+      print_timing (sizes[i], THREAD_CNT, timer_elapsed (start));
+    }
+}
+
+static void
+worker_thread (void *w_)
+{
+  struct worker *w = w_;
+
+  run_pairs (w->size);
+  sema_up (&w->done);
+}
+
+/* Allocates and frees PAIR_CNT blocks of SIZE bytes, or goes
+   through PAIR_CNT lookups if SIZE is LOOKUP. */
+static void
+run_pairs (size_t size)
+{
+  int i;
+
+  for (i = 0; i < PAIR_CNT; i++)
+    if (size != LOOKUP)
+      {
+        void *p = malloc (size);
+        if (p == NULL)
+          fail ("malloc(%zu) failed", size);
+        free (p);
+      }
+    else
+      {
+        void *dir = malloc (8);
+        void *name = malloc (15);
+        void *entry = malloc (20);
+        if (dir == NULL || name == NULL || entry == NULL)
+          fail ("malloc failed during lookup");
+        free (entry);
+        free (name);
+        free (dir);
+      }
+}
+
+/* Prints the TICKS that THREAD_CNT threads took to run PAIR_CNT
+   pairs of SIZE bytes each. */
+static void
+print_timing (size_t size, int thread_cnt, int64_t ticks)
+{
+  if (size == LOOKUP)
+    msg ("lookup, %d thread%s: %"PRId64" ticks",
+         thread_cnt, thread_cnt == 1 ? "" : "s", ticks);
+  else
+    msg ("%zu bytes, %d thread%s: %"PRId64" ticks",
+         size, thread_cnt, thread_cnt == 1 ? "" : "s", ticks);
+}
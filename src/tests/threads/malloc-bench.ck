@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing 'begin' message\n"
+  if !grep ($_ eq '(malloc-bench) begin', @output);
+fail "missing 'end' message\n"
+  if !grep ($_ eq '(malloc-bench) end', @output);
+
+for my $threads (1, 4) {
+    for my $what ('16 bytes', '64 bytes', '256 bytes', '512 bytes',
+		  '1024 bytes', 'lookup') {
+	fail "missing timing for $what in $threads threads\n"
+	  if !grep (/^\(malloc-bench\) $what, $threads threads?: \d+ ticks$/,
+		    @output);
+    }
+}
+pass;
@@ -0,0 +1,138 @@
+/* Stresses malloc() from several threads at once.  Each thread
+   repeatedly allocates blocks of assorted sizes, fills them with
+   a pattern, checks the pattern, and frees them in a scrambled
+   order, so that blocks keep moving between the threads'
+   magazines and the shared descriptors.  At the end, each thread
+   hands a batch of blocks to the main thread, which frees them,
+   so that blocks also end up in a magazine other than the one
+   they came from. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define THREAD_CNT 4            /* Number of allocating threads. */
+#define ROUND_CNT 100           /* Rounds per thread. */
+#define BLOCK_CNT 48            /* Blocks allocated per round. */
+
+struct worker
+  {
+    int id;                             /* Thread number. */
+    struct semaphore done;              /* Upped when finished. */
+    uint8_t *handoff[BLOCK_CNT];        /* Blocks left for main. */
+  };
+
+static thread_func worker_thread;
+static size_t block_size (int round, int i);
+static void fill_block (uint8_t *, size_t, int tag);
+static void check_block (const uint8_t *, size_t, int tag);
+
+void
+test_malloc_magazine (void) 
+{
+  static struct worker workers[THREAD_CNT];
+  int i, j;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      char name[16];
+
+      workers[i].id = i;
+      sema_init (&workers[i].done, 0);
+      snprintf (name, sizeof name, "worker %d", i);
+      thread_create (name, PRI_DEFAULT, worker_thread, &workers[i]);
+    }
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      sema_down (&workers[i].done);
+      for (j = 0; j < BLOCK_CNT; j++)
+        {
+          check_block (workers[i].handoff[j], block_size (ROUND_CNT, j),
+                       i + j);
+          free (workers[i].handoff[j]);
+        }
+      msg ("worker %d finished.", i);
+    }
+}
+
+static void
+worker_thread (void *w_) 
+{
+  struct worker *w = w_;
+  uint8_t *blocks[BLOCK_CNT];
+  int round, i;
+
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      for (i = 0; i < BLOCK_CNT; i++)
+        {
+          size_t size = block_size (round, i);
+          blocks[i] = malloc (size);
+          if (blocks[i] == NULL)
+            fail ("worker %d: malloc(%zu) failed", w->id, size);
+          fill_block (blocks[i], size, w->id + i);
+        }
+
+      /* Free odd blocks first, then even ones, so that frees
+         don't simply mirror the allocation order. */
+      for (i = 1; i < BLOCK_CNT; i += 2)
+        {
+          check_block (blocks[i], block_size (round, i), w->id + i);
+          free (blocks[i]);
+        }
+      for (i = 0; i < BLOCK_CNT; i += 2)
+        {
+          check_block (blocks[i], block_size (round, i), w->id + i);
+          free (blocks[i]);
+        }
+    }
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    {
+      size_t size = block_size (ROUND_CNT, i);
+      w->handoff[i] = malloc (size);
+      if (w->handoff[i] == NULL)
+        fail ("worker %d: malloc(%zu) failed", w->id, size);
+      fill_block (w->handoff[i], size, w->id + i);
+    }
+  sema_up (&w->done);
+}
+
+/* Returns the size of the I'th block allocated in ROUND.
+   Most blocks fall into the small size classes, but every so
+   often a block needs more than one page. */
+static size_t
+block_size (int round, int i) 
+{
+  if ((round + i) % 31 == 0)
+    return 5000;
+  return 1 + (round * 13 + i * 37) % (i % 4 == 0 ? 1000 : 200);
+}
+
+/* Fills the SIZE bytes at BLOCK with a pattern derived from
+   TAG. */
+static void
+fill_block (uint8_t *block, size_t size, int tag) 
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    block[i] = tag + i;
+}
+
+/* Checks that the SIZE bytes at BLOCK hold the pattern written
+   by fill_block() for TAG. */
+static void
+check_block (const uint8_t *block, size_t size, int tag) 
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (block[i] != (uint8_t) (tag + i))
+      fail ("block %p corrupted at byte %zu", block, i);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(malloc-magazine) begin
+(malloc-magazine) worker 0 finished.
+(malloc-magazine) worker 1 finished.
+(malloc-magazine) worker 2 finished.
+(malloc-magazine) worker 3 finished.
+(malloc-magazine) end
+EOF
+pass;
@@ -0,0 +1,74 @@
+/* Checks that the kernel and user pools lend free pages to each
+   other.  The kernel pool first grabs as many pages as it can,
+   which must be more than the user pool, whose reserve must
+   still be left alone.  After the kernel lets go, the user pool
+   must be able to grow past where it stopped, and once it lets
+   go too, the kernel pool must get all of its pages back. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+
+static void *grab_all (enum palloc_flags, size_t *cnt);
+static void free_all (void *pages);
+
+void
+test_palloc_borrow (void)
+{
+  void *kernel_pages, *user_pages, *more_user_pages;
+  size_t kernel_cnt, user_cnt, more_user_cnt, kernel_cnt_2;
+
+  kernel_pages = grab_all (0, &kernel_cnt);
+  user_pages = grab_all (PAL_USER, &user_cnt);
+  if (user_cnt == 0)
+    fail ("kernel pool ate the user pool's reserve");
+  if (kernel_cnt <= user_cnt)
+    fail ("kernel pool got %zu pages, user pool %zu", kernel_cnt, user_cnt);
+  msg ("kernel pool borrowed from user pool.");
+
+  free_all (kernel_pages);
+  more_user_pages = grab_all (PAL_USER, &more_user_cnt);
+  if (more_user_cnt == 0)
+    fail ("user pool could not borrow from kernel pool");
+  msg ("user pool borrowed from kernel pool.");
+
+  free_all (user_pages);
+  free_all (more_user_pages);
+  kernel_pages = grab_all (0, &kernel_cnt_2);
+  if (kernel_cnt_2 != kernel_cnt)
+    fail ("kernel pool got %zu pages back, expected %zu",
+          kernel_cnt_2, kernel_cnt);
+  free_all (kernel_pages);
+  msg ("kernel pool got its pages back.");
+}
+
+/* Allocates pages with FLAGS until the allocator refuses,
+   stores the number of pages in *CNT, and returns them chained
+   through their first word. */
+static void *
+grab_all (enum palloc_flags flags, size_t *cnt)
+{
+  void *head = NULL;
+  void **page;
+
+  *cnt = 0;
+  while ((page = palloc_get_page (flags)) != NULL)
+    {
+      *page = head;
+      head = page;
+      ++*cnt;
+    }
+  return head;
+}
+
+/* Frees a chain of pages returned by grab_all(). */
+static void
+free_all (void *pages)
+{
+  while (pages != NULL)
+    {
+      void *next = *(void **) pages;
+      palloc_free_page (pages);
+      pages = next;
+    }
+}
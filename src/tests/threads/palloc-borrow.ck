@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(palloc-borrow) begin
+(palloc-borrow) kernel pool borrowed from user pool.
+(palloc-borrow) user pool borrowed from kernel pool.
+(palloc-borrow) kernel pool got its pages back.
+(palloc-borrow) end
+EOF
+pass;
@@ -0,0 +1,74 @@
+/* Checks that the page allocator reclaims memory from kernel
+   caches before it gives up.  The test counts how many kernel
+   pages it can allocate, warms the cache of dead threads' pages
+   by running some short-lived threads, and then counts again.
+   Without shrinkers the pages held by the cache would be lost
+   to the second count. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 6
+
+static thread_func quick_thread;
+static size_t count_pages (void);
+
+void
+test_palloc_shrink (void)
+{
+  struct semaphore done;
+  size_t before, after;
+  int i;
+
+  before = count_pages ();
+
+  /* Warm the thread page cache. */
+  sema_init (&done, 0);
+  for (i = 0; i < THREAD_CNT; i++)
+    thread_create ("quick", PRI_DEFAULT, quick_thread, &done);
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+
+  /* Give the threads time to finish dying. */
+  timer_sleep (10);
+
+  after = count_pages ();
+  if (after != before)
+    fail ("%zu pages before warming caches, %zu after", before, after);
+  msg ("cached pages were reclaimed.");
+}
+
+static void
+quick_thread (void *done_)
+{
+  struct semaphore *done = done_;
+  sema_up (done);
+}
+
+/* Allocates kernel pages until the allocator refuses, frees them
+   all again, and returns how many there were. */
+static size_t
+count_pages (void)
+{
+  void *head = NULL;
+  void **page;
+  size_t cnt = 0;
+
+  while ((page = palloc_get_page (0)) != NULL)
+    {
+      *page = head;
+      head = page;
+      cnt++;
+    }
+  while (head != NULL)
+    {
+      page = head;
+      head = *page;
+      palloc_free_page (page);
+    }
+  return cnt;
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(palloc-shrink) begin
+(palloc-shrink) cached pages were reclaimed.
+(palloc-shrink) end
+EOF
+pass;
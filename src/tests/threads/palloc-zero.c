@@ -0,0 +1,56 @@
+/* Checks that pages requested with PAL_ZERO are always zeroed,
+   whether they come from the idle thread's pre-zeroed stack or
+   are cleared on the spot.  Each round sleeps to give the idle
+   thread time to refill the stack, then allocates more pages
+   than the stack holds, checks them, scribbles over them, and
+   frees them, so that dirty pages go back into the pool. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+#define ROUND_CNT 10            /* Number of rounds. */
+#define PAGE_CNT 96             /* Pages allocated per round. */
+
+static void check_zero (const uint8_t *page);
+
+void
+test_palloc_zero (void) 
+{
+  static uint8_t *pages[PAGE_CNT];
+  int round, i;
+
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      timer_sleep (5);
+
+      for (i = 0; i < PAGE_CNT; i++)
+        {
+          enum palloc_flags flags = PAL_ZERO | (i % 2 ? PAL_USER : 0);
+          pages[i] = palloc_get_page (flags);
+          if (pages[i] == NULL)
+            fail ("round %d: palloc_get_page() failed", round);
+          check_zero (pages[i]);
+          memset (pages[i], 0x5a, PGSIZE);
+        }
+
+      for (i = 0; i < PAGE_CNT; i++)
+        palloc_free_page (pages[i]);
+    }
+  msg ("%d rounds of %d pages zeroed.", ROUND_CNT, PAGE_CNT);
+}
+
+/* Fails if any byte of PAGE is nonzero. */
+static void
+check_zero (const uint8_t *page) 
+{
+  size_t i;
+
+  for (i = 0; i < PGSIZE; i++)
+    if (page[i] != 0)
+      fail ("page %p not zeroed at byte %zu", page, i);
+}
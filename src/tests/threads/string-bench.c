@@ -0,0 +1,187 @@
+/* Checks memcpy(), memmove(), memset(), memcmp(), and strlen()
+   against simple byte-at-a-time versions, at every alignment of
+   source and destination, for block sizes from 1 byte to 64 kB,
+   then times each of them at each size and prints the timer
+   ticks it took to process MB_PER_SIZE MB.  The timings vary
+   from run to run, so only their presence is checked. */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "devices/timer.h"
+
+#define MAX_SIZE (64 * 1024)    /* Largest block. */
+#define SLACK 8                 /* Room for alignment offsets. */
+#define MB_PER_SIZE 1           /* Megabytes processed per timing. */
+
+enum op
+  {
+    OP_MEMCPY, OP_MEMMOVE, OP_MEMSET, OP_MEMCMP, OP_STRLEN, OP_CNT
+  };
+
+static const char *op_names[OP_CNT] =
+  {"memcpy", "memmove", "memset", "memcmp", "strlen"};
+
+static uint8_t *a, *b, *c;
+
+static void check (size_t size, int dst_ofs, int src_ofs);
+static int64_t time_op (enum op, size_t size);
+
+void
+test_string_bench (void)
+{
+  size_t size;
+  int dst_ofs, src_ofs;
+  enum op op;
+
+  a = malloc (MAX_SIZE + SLACK);
+  b = malloc (MAX_SIZE + SLACK);
+  c = malloc (MAX_SIZE + SLACK);
+  if (a == NULL || b == NULL || c == NULL)
+    fail ("out of memory");
+
+  for (size = 1; size <= MAX_SIZE; size *= 2)
+    for (dst_ofs = 0; dst_ofs < 4; dst_ofs++)
+      for (src_ofs = 0; src_ofs < 4; src_ofs++)
+        {
+          check (size - 1, dst_ofs, src_ofs);
+          check (size, dst_ofs, src_ofs);
+          check (size + 1, dst_ofs, src_ofs);
+        }
+  msg ("results match byte-at-a-time versions");
+
+  for (op = 0; op < OP_CNT; op++)
+    for (size = 1; size <= MAX_SIZE; size *= 4)
+      msg ("%s %zu bytes: %"PRId64" ticks", op_names[op], size,
+           time_op (op, size));
+
+  free (a);
+  free (b);
+  free (c);
+}
+
+/* Fills the first SIZE bytes of BUF with a pattern that depends
+   on SEED. */
+static void
+fill (uint8_t *buf, size_t size, unsigned seed)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    buf[i] = (i * 7 + seed) % 251 + 1;
+}
+
+/* Fails unless the SIZE bytes at X and Y are equal, comparing a
+   byte at a time. */
+static void
+check_equal (const char *what, const uint8_t *x, const uint8_t *y, size_t size)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (x[i] != y[i])
+      fail ("%s: byte %zu differs", what, i);
+}
+
+/* Checks each operation on a SIZE-byte block at offset DST_OFS
+   in the destination and SRC_OFS in the source. */
+static void
+check (size_t size, int dst_ofs, int src_ofs)
+{
+  const size_t total = size + SLACK;
+  size_t i;
+  int cmp;
+
+  if (total > MAX_SIZE + SLACK)
+    return;
+
+  /* memcpy(): C gets the expected result. */
+  fill (a, total, 1);
+  fill (b, total, 2);
+  memcpy (c, b, total);
+  for (i = 0; i < size; i++)
+    c[dst_ofs + i] = a[src_ofs + i];
+  memcpy (b + dst_ofs, a + src_ofs, size);
+  check_equal ("memcpy", b, c, total);
+
+  /* memmove(), overlapping in both directions. */
+  fill (b, total, 3);
+  memcpy (c, b, total);
+  for (i = size; i-- > 0; )
+    c[dst_ofs + 4 + i] = c[src_ofs + i];
+  memmove (b + dst_ofs + 4, b + src_ofs, size);
+  check_equal ("memmove up", b, c, total);
+  for (i = 0; i < size; i++)
+    c[dst_ofs + i] = c[src_ofs + 4 + i];
+  memmove (b + dst_ofs, b + src_ofs + 4, size);
+  check_equal ("memmove down", b, c, total);
+
+  /* memset(). */
+  fill (b, total, 4);
+  memcpy (c, b, total);
+  for (i = 0; i < size; i++)
+    c[dst_ofs + i] = 0xa5;
+  memset (b + dst_ofs, 0xa5, size);
+  check_equal ("memset", b, c, total);
+
+  /* memcmp(), equal and with the last byte differing. */
+  fill (a, total, 5);
+  fill (b, total, 5);
+  if (memcmp (a + src_ofs, b + src_ofs, size) != 0)
+    fail ("memcmp: equal blocks of %zu bytes differ", size);
+  if (size > 0)
+    {
+      b[src_ofs + size - 1]++;
+      cmp = memcmp (a + src_ofs, b + src_ofs, size);
+      if (cmp >= 0)
+        fail ("memcmp: %zu-byte block compared %d, not < 0", size, cmp);
+    }
+
+  /* strlen(). */
+  fill (a, total, 6);
+  a[src_ofs + size] = '\0';
+  if (strlen ((char *) a + src_ofs) != size)
+    fail ("strlen: %zu-byte string has length %zu",
+          size, strlen ((char *) a + src_ofs));
+}
+
+/* Returns the timer ticks OP takes to process MB_PER_SIZE MB in
+   SIZE-byte blocks. */
+static int64_t
+time_op (enum op op, size_t size)
+{
+  size_t n = MB_PER_SIZE * 1024 * 1024 / size;
+  volatile size_t sink = 0;
+  int64_t start;
+
+  fill (a, MAX_SIZE + SLACK, 7);
+  memcpy (b, a, MAX_SIZE + SLACK);
+  a[size] = '\0';
+
+  start = timer_ticks ();
+  while (n-- > 0)
+    switch (op)
+      {
+      case OP_MEMCPY:
+        memcpy (b, a, size);
+        break;
+      case OP_MEMMOVE:
+        memmove (b + 1, b, size);
+        break;
+      case OP_MEMSET:
+        memset (b, n, size);
+        break;
+      case OP_MEMCMP:
+        sink += memcmp (a, b, size);
+        break;
+      case OP_STRLEN:
+        sink += strlen ((char *) a);
+        break;
+      default:
+        NOT_REACHED ();
+      }
+  return timer_elapsed (start);
+}
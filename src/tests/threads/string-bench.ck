@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing 'begin' message\n"
+  if !grep ($_ eq '(string-bench) begin', @output);
+fail "missing 'end' message\n"
+  if !grep ($_ eq '(string-bench) end', @output);
+fail "results did not match\n"
+  if !grep ($_ eq '(string-bench) results match byte-at-a-time versions',
+	    @output);
+
+for my $op (qw (memcpy memmove memset memcmp strlen)) {
+    for (my $size = 1; $size <= 65536; $size *= 4) {
+	fail "missing timing for $op on $size bytes\n"
+	  if !grep (/^\(string-bench\) $op $size bytes: \d+ ticks$/, @output);
+    }
+}
+pass;
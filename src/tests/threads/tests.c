@@ -41,6 +41,15 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"malloc-magazine", test_malloc_magazine},
+    {"palloc-zero", test_palloc_zero},
+    {"palloc-borrow", test_palloc_borrow},
+    {"vmalloc-frag", test_vmalloc_frag},
+    {"palloc-shrink", test_palloc_shrink},
+    {"string-bench", test_string_bench},
+    {"malloc-bench", test_malloc_bench},
+    {"tlb-bench", test_tlb_bench},
+    {"tlb-bench-small", test_tlb_bench},
   };
 
 static const char *test_name;
@@ -35,6 +35,14 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_malloc_magazine;
+extern test_func test_palloc_zero;
+extern test_func test_palloc_borrow;
+extern test_func test_vmalloc_frag;
+extern test_func test_palloc_shrink;
+extern test_func test_string_bench;
+extern test_func test_malloc_bench;
+extern test_func test_tlb_bench;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing 'begin' message\n"
+  if !grep ($_ eq '(tlb-bench-small) begin', @output);
+fail "missing 'end' message\n"
+  if !grep ($_ eq '(tlb-bench-small) end', @output);
+fail "large pages used despite -smallpages\n"
+  if !grep (/^\(tlb-bench-small\) 0 of \d+ 4 MB chunks mapped with large /,
+	    @output);
+fail "missing timing\n"
+  if !grep (/^\(tlb-bench-small\) \d+ passes over \d+ pages: \d+ ticks$/,
+	    @output);
+pass;
@@ -0,0 +1,61 @@
+/* Measures how the size of the kernel's mappings of physical
+   memory affects a TLB-bound workload.  Reports how many 4 MB
+   chunks of RAM are mapped with large pages, then reads one word
+   from every page of RAM through the kernel's mapping, visiting
+   the pages in a scattered order so that almost every access
+   needs a new TLB entry, and prints the timer ticks that
+   ROUND_CNT such passes took.
+
+   Run as tlb-bench, the kernel maps RAM with 4 MB pages where it
+   can; run as tlb-bench-small, the kernel is booted with
+   -smallpages and uses only 4 kB pages, so comparing the two
+   timings compares the mapping sizes.  The timings vary from run
+   to run, so only their presence is checked. */
+
+#include <inttypes.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/loader.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+#define ROUND_CNT 100           /* Passes over all of RAM. */
+#define STRIDE 1031             /* Pages between visits, a prime. */
+
+void
+test_tlb_bench (void)
+{
+  size_t chunk_cnt = DIV_ROUND_UP (init_ram_pages, PTSPAN / PGSIZE);
+  size_t large_cnt = 0;
+  volatile uint32_t sink = 0;
+  int64_t start;
+  size_t i;
+  int round;
+
+  for (i = 0; i < chunk_cnt; i++)
+    {
+      uint32_t pde = init_page_dir[pd_no (ptov (i * PTSPAN))];
+      if (pde & PTE_PS)
+        large_cnt++;
+    }
+  msg ("%zu of %zu 4 MB chunks mapped with large pages",
+       large_cnt, chunk_cnt);
+
+  start = timer_ticks ();
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      size_t page = 0;
+
+      for (i = 0; i < init_ram_pages; i++)
+        {
+          sink += *(uint32_t *) ptov (page * PGSIZE);
+          page = (page + STRIDE) % init_ram_pages;
+        }
+    }
+  msg ("%d passes over %"PRIu32" pages: %"PRId64" ticks",
+       ROUND_CNT, init_ram_pages, timer_elapsed (start));
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing 'begin' message\n"
+  if !grep ($_ eq '(tlb-bench) begin', @output);
+fail "missing 'end' message\n"
+  if !grep ($_ eq '(tlb-bench) end', @output);
+fail "missing large page count\n"
+  if !grep (/^\(tlb-bench\) \d+ of \d+ 4 MB chunks mapped with large /,
+	    @output);
+fail "missing timing\n"
+  if !grep (/^\(tlb-bench\) \d+ passes over \d+ pages: \d+ ticks$/, @output);
+pass;
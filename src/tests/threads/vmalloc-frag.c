@@ -0,0 +1,141 @@
+/* Checks that large buffers can still be allocated when physical
+   memory is badly fragmented.  The test takes every kernel page
+   it can get and then gives back every other one, so that no two
+   free pages are adjacent.  It then allocates large buffers with
+   vmalloc() and malloc(), both at once and in a churning mix of
+   sizes, and checks that their contents survive. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "threads/vmalloc.h"
+
+#define BIG_PAGES 24            /* Pages in the big buffers. */
+#define SLOT_CNT 6              /* Buffers live at once while churning. */
+#define ROUND_CNT 60            /* Churning rounds. */
+
+static void *fragment_memory (void);
+static void free_all (void *pages);
+static void fill (uint8_t *, size_t, int tag);
+static void check (const uint8_t *, size_t, int tag);
+
+void
+test_vmalloc_frag (void)
+{
+  static uint8_t *slots[SLOT_CNT];
+  static size_t sizes[SLOT_CNT];
+  void *held;
+  uint8_t *v, *m;
+  size_t size = BIG_PAGES * PGSIZE;
+  int i;
+
+  held = fragment_memory ();
+
+  v = vmalloc (size);
+  if (v == NULL)
+    fail ("vmalloc() of %zu bytes failed", size);
+  m = malloc (size);
+  if (m == NULL)
+    fail ("malloc() of %zu bytes failed", size);
+  fill (v, size, 1);
+  fill (m, size, 2);
+  check (v, size, 1);
+  check (m, size, 2);
+  vfree (v);
+  free (m);
+  msg ("big buffers allocated in fragmented memory.");
+
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      int slot = i % SLOT_CNT;
+
+      if (slots[slot] != NULL)
+        {
+          check (slots[slot], sizes[slot], slot);
+          vfree (slots[slot]);
+        }
+      sizes[slot] = 1 + (i * 7919) % (8 * PGSIZE);
+      slots[slot] = vmalloc (sizes[slot]);
+      if (slots[slot] == NULL)
+        fail ("round %d: vmalloc() of %zu bytes failed", i, sizes[slot]);
+      fill (slots[slot], sizes[slot], slot);
+    }
+  for (i = 0; i < SLOT_CNT; i++)
+    {
+      check (slots[i], sizes[i], i);
+      vfree (slots[i]);
+    }
+  msg ("%d rounds of churn survived.", ROUND_CNT);
+
+  free_all (held);
+}
+
+/* Takes every kernel page the allocator will give out, then frees
+   every other one.  Returns the pages still held, chained through
+   their first word. */
+static void *
+fragment_memory (void)
+{
+  void *all = NULL, *held = NULL;
+  void **page;
+  bool keep = true;
+
+  while ((page = palloc_get_page (0)) != NULL)
+    {
+      *page = all;
+      all = page;
+    }
+
+  while (all != NULL)
+    {
+      page = all;
+      all = *page;
+      if (keep)
+        {
+          *page = held;
+          held = page;
+        }
+      else
+        palloc_free_page (page);
+      keep = !keep;
+    }
+  return held;
+}
+
+/* Frees a chain of pages returned by fragment_memory(). */
+static void
+free_all (void *pages)
+{
+  while (pages != NULL)
+    {
+      void *next = *(void **) pages;
+      palloc_free_page (pages);
+      pages = next;
+    }
+}
+
+/* Fills the SIZE bytes at BUF with a pattern derived from TAG. */
+static void
+fill (uint8_t *buf, size_t size, int tag)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    buf[i] = tag + i / 7;
+}
+
+/* Checks that the SIZE bytes at BUF hold the pattern written by
+   fill() for TAG. */
+static void
+check (const uint8_t *buf, size_t size, int tag)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (buf[i] != (uint8_t) (tag + i / 7))
+      fail ("buffer %p corrupted at byte %zu", buf, i);
+}
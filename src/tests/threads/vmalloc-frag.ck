@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(vmalloc-frag) begin
+(vmalloc-frag) big buffers allocated in fragmented memory.
+(vmalloc-frag) 60 rounds of churn survived.
+(vmalloc-frag) end
+EOF
+pass;
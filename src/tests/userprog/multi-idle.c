@@ -0,0 +1,49 @@
+/* Executes itself recursively until exec() fails, each process
+   waiting idle for its child, and reports how many processes
+   were alive at once.  Fails if fewer than MIN_PROCS fit in
+   memory, which catches per-process kernel overhead growing.
+
+   The first command-line argument, if present, is the depth of
+   this process in the chain; the first process has none. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Fewest processes that must fit. */
+#define MIN_PROCS 30
+
+/* Stop here even if memory remains. */
+#define MAX_PROCS 1000
+
+int
+main (int argc, char *argv[])
+{
+  int depth = argc > 1 ? atoi (argv[1]) : 0;
+  int deepest = depth;
+
+  test_name = "multi-idle";
+  if (depth == 0)
+    msg ("begin");
+
+  if (depth + 1 < MAX_PROCS)
+    {
+      char child_cmd[128];
+      pid_t child_pid;
+
+      snprintf (child_cmd, sizeof child_cmd, "multi-idle %d", depth + 1);
+      child_pid = exec (child_cmd);
+      if (child_pid != -1)
+        deepest = wait (child_pid);
+    }
+
+  if (depth == 0)
+    {
+      if (deepest + 1 < MIN_PROCS)
+        fail ("only %d processes fit in memory", deepest + 1);
+      msg ("at least %d processes were alive at once", MIN_PROCS);
+      msg ("end");
+    }
+  return deepest;
+}
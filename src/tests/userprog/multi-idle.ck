@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+# Children that fail to load may print a message of their own,
+# so look only for the lines the first process prints.
+@output = grep (/^\(multi-idle\) /, @output);
+my (@expected) = ('(multi-idle) begin',
+		  '(multi-idle) at least 30 processes were alive at once',
+		  '(multi-idle) end');
+fail "expected:\n" . join ('', map ("  $_\n", @expected))
+  . "got:\n" . join ('', map ("  $_\n", @output))
+  if join ("\n", @output) ne join ("\n", @expected);
+pass;
@@ -0,0 +1,46 @@
+/* Opens the same file hundreds of times, which must succeed
+   with a different file descriptor each time.  Then closes one
+   and opens the file again, which must reuse the lowest free
+   descriptor, and reads through the last descriptor. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define OPEN_CNT 300
+
+void
+test_main (void) 
+{
+  static int handles[OPEN_CNT];
+  char buffer[sizeof sample];
+  int i, handle;
+
+  for (i = 0; i < OPEN_CNT; i++)
+    {
+      handles[i] = open ("sample.txt");
+      if (handles[i] < 2)
+        fail ("open #%d returned %d", i, handles[i]);
+      if (i > 0 && handles[i] <= handles[i - 1])
+        fail ("open #%d returned %d after %d",
+              i, handles[i], handles[i - 1]);
+    }
+  msg ("opened \"sample.txt\" %d times", OPEN_CNT);
+
+  close (handles[OPEN_CNT / 3]);
+  close (handles[OPEN_CNT / 2]);
+  CHECK ((handle = open ("sample.txt")) == handles[OPEN_CNT / 3],
+         "open \"sample.txt\" reuses lowest free descriptor");
+
+  CHECK (read (handles[OPEN_CNT - 1], buffer, sizeof sample - 1)
+         == (int) sizeof sample - 1, "read through last descriptor");
+  buffer[sizeof sample - 1] = '\0';
+  if (strcmp (sample, buffer))
+    fail ("expected text differs from actual");
+
+  for (i = 0; i < OPEN_CNT; i++)
+    if (i != OPEN_CNT / 2)
+      close (handles[i]);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(open-many) begin
+(open-many) opened "sample.txt" 300 times
+(open-many) open "sample.txt" reuses lowest free descriptor
+(open-many) read through last descriptor
+(open-many) end
+open-many: exit(0)
+EOF
+pass;
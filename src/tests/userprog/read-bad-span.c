@@ -0,0 +1,19 @@
+/* Reads into a buffer whose first bytes are valid but whose
+   last bytes are not.  The process must be terminated with -1
+   exit code. */
+
+#include <syscall.h>
+#include "tests/userprog/boundary.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  read (handle, (char *) get_bad_boundary () - 16, 64);
+  fail ("should have exited with -1");
+}
@@ -0,0 +1,48 @@
+/* Writes a file from several buffers with writev(), reads it
+   back at an offset with pread(), overwrites part of it with
+   pwrite(), and reads it again into several buffers with
+   readv(), checking the data and the file position each time. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char a[] = "abc", b[] = "defgh", c[] = "ij";
+  struct iovec out[3] =
+    {
+      {a, 3}, {b, 5}, {c, 2},
+    };
+  char first[4], second[6], buffer[11];
+  struct iovec in[2] =
+    {
+      {first, sizeof first}, {second, sizeof second},
+    };
+  int handle;
+
+  CHECK (create ("iovec", 1024), "create \"iovec\"");
+  CHECK ((handle = open ("iovec")) > 1, "open \"iovec\"");
+
+  CHECK (writev (handle, out, 3) == 10, "writev 3 buffers");
+  if (tell (handle) != 10)
+    fail ("position %u after writev, not 10", tell (handle));
+
+  memset (buffer, 0, sizeof buffer);
+  CHECK (pread (handle, buffer, 10, 0) == 10, "pread at offset 0");
+  if (strcmp (buffer, "abcdefghij"))
+    fail ("pread returned \"%s\"", buffer);
+  if (tell (handle) != 10)
+    fail ("position %u after pread, not 10", tell (handle));
+
+  CHECK (pwrite (handle, "XY", 2, 3) == 2, "pwrite at offset 3");
+
+  seek (handle, 0);
+  CHECK (readv (handle, in, 2) == 10, "readv 2 buffers");
+  if (memcmp (first, "abcX", 4) || memcmp (second, "Yfghij", 6))
+    fail ("readv returned \"%.4s\" and \"%.6s\"", first, second);
+  if (tell (handle) != 10)
+    fail ("position %u after readv, not 10", tell (handle));
+}
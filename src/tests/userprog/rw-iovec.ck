@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rw-iovec) begin
+(rw-iovec) create "iovec"
+(rw-iovec) open "iovec"
+(rw-iovec) writev 3 buffers
+(rw-iovec) pread at offset 0
+(rw-iovec) pwrite at offset 3
+(rw-iovec) readv 2 buffers
+(rw-iovec) end
+rw-iovec: exit(0)
+EOF
+pass;
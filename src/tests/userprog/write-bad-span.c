@@ -0,0 +1,16 @@
+/* Writes to the console from a buffer whose first bytes are
+   valid but whose last bytes are not.  The process must be
+   terminated with -1 exit code. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/userprog/boundary.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  write (STDOUT_FILENO, (char *) get_bad_boundary () - 16, 64);
+  fail ("should have exited with -1");
+}
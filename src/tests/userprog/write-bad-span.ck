@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(write-bad-span) begin
+write-bad-span: exit(-1)
+EOF
+pass;
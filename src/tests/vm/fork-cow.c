@@ -0,0 +1,54 @@
+/* Forks a child that overwrites its copy of the parent's data
+   and stack, and checks that the parent's copy is unchanged.
+   The child checks that it started with the parent's data. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (4 * 4096)
+
+static char data[SIZE];
+
+/* Returns true if all SIZE bytes of BUF are C. */
+static bool
+all_are (const char *buf, char c)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != c)
+      return false;
+  return true;
+}
+
+void
+test_main (void)
+{
+  char stack[SIZE];
+  pid_t pid;
+
+  memset (data, 'p', SIZE);
+  memset (stack, 'p', SIZE);
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      /* Child. */
+      if (!all_are (data, 'p') || !all_are (stack, 'p'))
+        exit (1);
+      memset (data, 'c', SIZE);
+      memset (stack, 'c', SIZE);
+      exit (all_are (data, 'c') && all_are (stack, 'c') ? 42 : 2);
+    }
+
+  if (pid == PID_ERROR)
+    fail ("fork failed");
+  if (wait (pid) != 42)
+    fail ("child did not see its own copy");
+  msg ("child wrote its own copy");
+  if (!all_are (data, 'p') || !all_are (stack, 'p'))
+    fail ("parent's copy changed");
+  msg ("parent kept its own copy");
+}
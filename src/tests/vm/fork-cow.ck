@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-cow) begin
+fork-cow: exit(42)
+(fork-cow) child wrote its own copy
+(fork-cow) parent kept its own copy
+(fork-cow) end
+fork-cow: exit(0)
+EOF
+pass;
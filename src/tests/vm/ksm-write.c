@@ -0,0 +1,39 @@
+/* Fills two arrays with the same contents, gives the kernel's
+   merge daemon time to merge their pages, then writes to one
+   array and checks that the other did not change.  The resident
+   set size counts each page, even when merged pages share a
+   frame, so it does not show the merge; the .ck file checks the
+   kernel's merge count instead. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (16 * 4096)
+
+static char a[SIZE];
+static char b[SIZE];
+
+void
+test_main (void)
+{
+  volatile int spin;
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    a[i] = b[i] = i % 251;
+
+  msg ("waiting");
+  for (spin = 0; spin < 20 * 1000 * 1000; spin++)
+    continue;
+
+  msg ("writing a");
+  memset (a, 'a', SIZE);
+  for (i = 0; i < SIZE; i++)
+    if (b[i] != (char) (i % 251))
+      fail ("b[%zu] changed to %d", i, b[i]);
+  for (i = 0; i < SIZE; i++)
+    if (a[i] != 'a')
+      fail ("a[%zu] is %d", i, a[i]);
+  msg ("b is unchanged");
+}
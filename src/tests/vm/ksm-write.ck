@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(ksm-write) begin
+(ksm-write) waiting
+(ksm-write) writing a
+(ksm-write) b is unchanged
+(ksm-write) end
+EOF
+
+# Without merging the test would pass just the same, so check
+# that the merge daemon actually merged some of the pages.
+our ($test);
+my (@output) = read_text_file ("$test.output");
+my ($merged) = map (/^Merging: \d+ frames scanned in \d+ ticks, (\d+) merged$/,
+		    @output);
+fail "missing merge statistics\n" if !defined $merged;
+fail "no frames were merged\n" if $merged == 0;
+pass;
@@ -0,0 +1,36 @@
+/* Reads a large zero-filled array, which should not take a
+   frame per page, then writes to every other page and checks
+   that the pages written, and only those, changed. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 256
+#define SIZE (PAGE_CNT * 4096)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  unsigned rss;
+  size_t i;
+
+  rss = getrss ();
+  msg ("read pass");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != 0)
+      fail ("byte %zu != 0", i);
+  if (getrss () - rss >= PAGE_CNT / 2)
+    fail ("reading took %u frames", getrss () - rss);
+
+  msg ("write pass");
+  for (i = 0; i < SIZE; i += 2 * 4096)
+    buf[i] = 1;
+
+  msg ("check pass");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (i % (2 * 4096) == 0))
+      fail ("byte %zu is %d", i, buf[i]);
+}
@@ -0,0 +1,27 @@
+/* Recurse 2,000 calls deep, with a 256-byte buffer in each
+   frame, so that the stack grows a page at a time to over half
+   a megabyte.
+   This must succeed. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define DEPTH 2000
+
+static int
+recurse (int depth)
+{
+  volatile unsigned char frame[256];
+  int sum;
+
+  memset ((unsigned char *) frame, depth & 0xff, sizeof frame);
+  sum = depth == 0 ? 0 : recurse (depth - 1);
+  return sum + frame[depth % sizeof frame];
+}
+
+void
+test_main (void)
+{
+  msg ("sum: %d", recurse (DEPTH - 1));
+}
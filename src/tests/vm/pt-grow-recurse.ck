@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(pt-grow-recurse) begin
+(pt-grow-recurse) sum: 250008
+(pt-grow-recurse) end
+EOF
+pass;
@@ -0,0 +1,36 @@
+/* Limits the process to LIMIT resident pages, then writes and
+   reads back a buffer several times that size, checking that
+   the process stays within its limit and its data survives
+   being paged out. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define LIMIT 16
+#define SIZE (4 * LIMIT * 4096)
+
+static unsigned char buf[SIZE];
+
+void
+test_main (void)
+{
+  size_t i;
+
+  rsslimit (LIMIT);
+
+  msg ("write pass");
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i * 7;
+  if (getrss () > LIMIT)
+    fail ("%u pages resident after write pass", getrss ());
+
+  msg ("read pass");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (unsigned char) (i * 7))
+      fail ("byte %zu is %d, should be %d",
+            i, buf[i], (unsigned char) (i * 7));
+  if (getrss () > LIMIT)
+    fail ("%u pages resident after read pass", getrss ());
+  msg ("stayed within %d pages", LIMIT);
+}
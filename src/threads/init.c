@@ -19,9 +19,11 @@
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/memprof.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/vmalloc.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -37,10 +39,19 @@
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
 
+/* CPU feature and control register bits for large pages. */
+#define CPUID_PSE 0x00000008    /* CPUID.1:EDX Page Size Extension. */
+#define CR4_PSE 0x00000010      /* CR4 Page Size Extension. */
+
 #ifdef FILESYS
 /* -f: Format the file system? */
 static bool format_filesys;
@@ -54,11 +65,15 @@ static const char *swap_bdev_name;
 #endif
 #endif /* FILESYS */
 
+/* -smallpages: Map physical memory with 4 kB pages only? */
+static bool small_pages;
+
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
 static void bss_init (void);
 static void paging_init (void);
+static bool cpu_has_pse (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -98,6 +113,8 @@ main (void)
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+  vmalloc_init ();
+  memprof_init ();
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -126,6 +143,11 @@ main (void)
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
+#ifdef VM
+  /* Initialize virtual memory. */
+  frame_init ();
+  swap_init ();
+#endif
 
   printf ("Boot complete.\n");
 
@@ -153,13 +175,22 @@ bss_init (void)
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   Where the CPU supports it, each 4 MB of physical memory is
+   mapped with a single large page, which takes one TLB entry
+   instead of 1,024.  The 4 MB that hold the kernel's code, and
+   the tail of RAM that does not fill a whole 4 MB, are mapped
+   with 4 kB pages, the former so that the code can be mapped
+   read-only.  Page directories created by pagedir_create()
+   copy these mappings, so processes get them too. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  bool use_large = !small_pages && cpu_has_pse ();
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
@@ -171,6 +202,15 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (use_large && pte_idx == 0
+          && init_ram_pages - page >= PTSPAN / PGSIZE
+          && (&_end_kernel_text <= vaddr || vaddr + PTSPAN <= &_start))
+        {
+          pd[pde_idx] = pde_create_large (vaddr, true);
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -180,6 +220,18 @@ paging_init (void)
       pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
     }
 
+  /* Large pages need the Page Size Extension turned on in CR4
+     before they are used.  See [IA32-v3a] 2.5 "Control
+     Registers". */
+  if (use_large)
+    {
+      uint32_t cr4;
+
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      cr4 |= CR4_PSE;
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+    }
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
@@ -188,6 +240,17 @@ paging_init (void)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
 }
 
+/* Returns true if the CPU supports 4 MB pages, as reported by
+   the PSE feature flag of CPUID.  See [IA32-v2a] "CPUID". */
+static bool
+cpu_has_pse (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return (edx & CPUID_PSE) != 0;
+}
+
 /* Breaks the kernel command line into words and returns them as
    an argv-like array. */
 static char **
@@ -256,6 +319,12 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-poison"))
+        malloc_poison = true;
+      else if (!strcmp (name, "-smallpages"))
+        small_pages = true;
+      else if (!strcmp (name, "-memprof"))
+        memprof_enabled = true;
 #ifndef USERPROG
       else if (!strcmp (name, "-aging"))
         thread_prior_aging = true;
@@ -263,6 +332,18 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-sl"))
+        stack_page_limit = atoi (value);
+      else if (!strcmp (name, "-zl"))
+        zswap_limit = atoi (value) * 1024;
+      else if (!strcmp (name, "-rlow"))
+        reclaim_low = atoi (value);
+      else if (!strcmp (name, "-rhigh"))
+        reclaim_high = atoi (value);
+      else if (!strcmp (name, "-ksm"))
+        ksm_rate = atoi (value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -383,8 +464,18 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -poison            Fill freed malloc() blocks with 0xcc.\n"
+          "  -smallpages        Don't map physical memory with 4 MB pages.\n"
+          "  -memprof           Profile malloc() and palloc allocations.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -sl=COUNT          Limit user stacks to COUNT pages.\n"
+          "  -zl=KB             Limit compressed swap cache to KB kB.\n"
+          "  -rlow=COUNT        Reclaim frames when under COUNT are free.\n"
+          "  -rhigh=COUNT       Stop reclaiming when COUNT are free.\n"
+          "  -ksm=COUNT         Merge identical pages, scanning COUNT/s.\n"
 #endif
           );
   shutdown_power_off ();
@@ -5,42 +5,69 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/memprof.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "threads/vmalloc.h"
 
 /* A simple implementation of malloc().
 
    The size of each request, in bytes, is rounded up to a power
    of 2 and assigned to the "descriptor" that manages blocks of
-   that size.  The descriptor keeps a list of free blocks.  If
-   the free list is nonempty, one of its blocks is used to
-   satisfy the request.
+   that size.  The descriptor keeps a list of the arenas that
+   have at least one free block, and each arena keeps a list of
+   its own free blocks.  If some arena has a free block, that
+   block is used to satisfy the request.
 
    Otherwise, a new page of memory, called an "arena", is
    obtained from the page allocator (if none is available,
    malloc() returns a null pointer).  The new arena is divided
-   into blocks, all of which are added to the descriptor's free
+   into blocks, all of which are added to the arena's free
    list.  Then we return one of the new blocks.
 
-   When we free a block, we add it to its descriptor's free list.
-   But if the arena that the block was in now has no in-use
-   blocks, we remove all of the arena's blocks from the free list
-   and give the arena back to the page allocator.
+   When we free a block, we add it to its arena's free list.
+   If the arena that the block was in now has no in-use blocks,
+   we take the arena off the descriptor's list and give it back
+   to the page allocator.
+
+   Taking the descriptor's lock on every call is expensive, so
+   each thread also keeps a "magazine" per small size class: a
+   short stack of free blocks that only that thread touches, so
+   it needs no locking.  malloc() pops from the magazine and
+   free() pushes onto it.  Only when a magazine runs empty or
+   full does the thread take the descriptor's lock, and then it
+   moves half a magazine's worth of blocks at once.  A thread
+   returns its magazines' blocks to the descriptors when it
+   exits.  Blocks held in magazines count as in use as far as
+   their arenas are concerned.
+
+   A thread's magazines are not part of struct thread, where
+   they would take up room on every kernel stack.  Instead they
+   are allocated, straight from a descriptor, the first time the
+   thread allocates or frees a small block.  If that fails, the
+   thread simply goes to the descriptors every time.
 
    We can't handle blocks bigger than 2 kB using this scheme,
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.  If
+   physical memory is too fragmented for that, we get the pages
+   from vmalloc() instead, which only needs them to be
+   contiguous in virtual memory. */
 
 /* Descriptor. */
 struct desc
   {
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
-    struct list free_list;      /* List of free blocks. */
+    size_t mag_size;            /* Blocks in a full magazine, 0 if none. */
+    struct list arena_list;     /* Arenas with at least one free block. */
     struct lock lock;           /* Lock. */
+    long long hit_cnt;          /* # of requests served by magazines. */
+    long long swap_cnt;         /* # of magazine refills and flushes. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -52,6 +79,8 @@ struct arena
     unsigned magic;             /* Always set to ARENA_MAGIC. */
     struct desc *desc;          /* Owning descriptor, null for big block. */
     size_t free_cnt;            /* Free blocks; pages in big block. */
+    struct list free_list;      /* List of free blocks. */
+    struct list_elem desc_elem; /* Element in descriptor's arena_list. */
   };
 
 /* Free block. */
@@ -64,8 +93,21 @@ struct block
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* If true, fill freed blocks with 0xcc. */
+bool malloc_poison;
+
+/* Descriptor that a thread's magazines are allocated from. */
+static struct desc *mags_desc;
+
+static void *alloc_block (size_t);
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static struct block *depot_get (struct desc *);
+static void depot_put (struct desc *, struct block *);
+static struct malloc_magazine *thread_magazine (struct desc *);
+static bool magazine_fill (struct desc *, struct malloc_magazine *);
+static void magazine_flush (struct desc *, struct malloc_magazine *,
+                            size_t cnt);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -79,19 +121,44 @@ malloc_init (void)
       ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
-      list_init (&d->free_list);
+
+      /* Keep magazines small compared to an arena, so that few
+         blocks are stranded in threads that stop allocating. */
+      d->mag_size = d->blocks_per_arena / 4;
+      if (d->mag_size > MALLOC_MAG_ROUNDS)
+        d->mag_size = MALLOC_MAG_ROUNDS;
+      if (desc_cnt > MALLOC_MAG_CLASSES)
+        d->mag_size = 0;
+
+      list_init (&d->arena_list);
       lock_init (&d->lock);
     }
+
+  for (mags_desc = descs; mags_desc < descs + desc_cnt; mags_desc++)
+    if (mags_desc->block_size
+        >= sizeof (struct malloc_magazine) * MALLOC_MAG_CLASSES)
+      break;
+  ASSERT (mags_desc < descs + desc_cnt);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) 
+{
+  void *p = alloc_block (size);
+  memprof_alloc (p, size, __builtin_return_address (0));
+  return p;
+}
+
+/* Does the work of malloc(), without profiling. */
+static void *
+alloc_block (size_t size) 
 {
   struct desc *d;
   struct block *b;
   struct arena *a;
+  struct malloc_magazine *m;
 
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
@@ -105,9 +172,13 @@ malloc (size_t size)
   if (d == descs + desc_cnt) 
     {
       /* SIZE is too big for any descriptor.
-         Allocate enough pages to hold SIZE plus an arena. */
+         Allocate enough pages to hold SIZE plus an arena.  The
+         block is reported to the profiler below, so the pages
+         are not. */
       size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
-      a = palloc_get_multiple (0, page_cnt);
+      a = palloc_get_multiple (PAL_NOPROF, page_cnt);
+      if (a == NULL && page_cnt > 1)
+        a = vmalloc (page_cnt * PGSIZE);
       if (a == NULL)
         return NULL;
 
@@ -119,36 +190,19 @@ malloc (size_t size)
       return a + 1;
     }
 
-  lock_acquire (&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
+  /* Serve the request from the current thread's magazine,
+     refilling it from the descriptor if it is empty. */
+  if (d->mag_size > 0 && (m = thread_magazine (d)) != NULL)
     {
-      size_t i;
-
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
-
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
-        }
+      if (m->cnt > 0)
+        m->hit_cnt++;
+      else if (!magazine_fill (d, m))
+        return NULL;
+      return m->rounds[--m->cnt];
     }
 
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
+  lock_acquire (&d->lock);
+  b = depot_get (d);
   lock_release (&d->lock);
   return b;
 }
@@ -167,9 +221,10 @@ calloc (size_t a, size_t b)
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc (size);
+  p = alloc_block (size);
   if (p != NULL)
     memset (p, 0, size);
+  memprof_alloc (p, size, __builtin_return_address (0));
 
   return p;
 }
@@ -201,7 +256,8 @@ realloc (void *old_block, size_t new_size)
     }
   else 
     {
-      void *new_block = malloc (new_size);
+      void *new_block = alloc_block (new_size);
+      memprof_alloc (new_block, new_size, __builtin_return_address (0));
       if (old_block != NULL && new_block != NULL)
         {
           size_t old_size = block_size (old_block);
@@ -220,49 +276,239 @@ free (void *p)
 {
   if (p != NULL)
     {
+      memprof_free (p);
+
       struct block *b = p;
       struct arena *a = block_to_arena (b);
       struct desc *d = a->desc;
+      struct malloc_magazine *m;
       
       if (d != NULL) 
         {
           /* It's a normal block.  We handle it here. */
 
-#ifndef NDEBUG
           /* Clear the block to help detect use-after-free bugs. */
-          memset (b, 0xcc, d->block_size);
-#endif
-  
-          lock_acquire (&d->lock);
+          if (malloc_poison)
+            memset (b, 0xcc, d->block_size);
 
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          if (d->mag_size > 0 && (m = thread_magazine (d)) != NULL)
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
+              /* Push the block onto the current thread's
+                 magazine, making room first if it is full. */
+              if (m->cnt >= d->mag_size)
+                magazine_flush (d, m, (d->mag_size + 1) / 2);
+              else
+                m->hit_cnt++;
+              m->rounds[m->cnt++] = b;
+            }
+          else
+            {
+              lock_acquire (&d->lock);
+              depot_put (d, b);
+              lock_release (&d->lock);
             }
-
-          lock_release (&d->lock);
         }
       else
         {
           /* It's a big block.  Free its pages. */
-          palloc_free_multiple (a, a->free_cnt);
+          if (is_vmalloc_vaddr (a))
+            vfree (a);
+          else
+            palloc_free_multiple (a, a->free_cnt);
           return;
         }
     }
 }
-
+
+/* Returns the blocks held in the current thread's magazines to
+   their descriptors, then frees the magazines themselves.
+   Called by a thread that is exiting, after its last call to
+   malloc() or free(). */
+void
+malloc_thread_exit (void)
+{
+  struct thread *t = thread_current ();
+  size_t i;
+
+  if (t->malloc_mags == NULL)
+    return;
+
+  for (i = 0; i < desc_cnt; i++)
+    if (descs[i].mag_size > 0)
+      magazine_flush (&descs[i], &t->malloc_mags[i], t->malloc_mags[i].cnt);
+
+  lock_acquire (&mags_desc->lock);
+  depot_put (mags_desc, (struct block *) t->malloc_mags);
+  lock_release (&mags_desc->lock);
+  t->malloc_mags = NULL;
+}
+
+/* Prints malloc statistics.  Hits in magazines that have not
+   been refilled or flushed since are not yet counted.  Takes no
+   locks, because it is called at shutdown, possibly from a
+   kernel panic. */
+void
+malloc_print_stats (void)
+{
+  long long hit_cnt = 0, swap_cnt = 0;
+  size_t i;
+
+  for (i = 0; i < desc_cnt; i++)
+    {
+      hit_cnt += descs[i].hit_cnt;
+      swap_cnt += descs[i].swap_cnt;
+    }
+  printf ("Malloc: %lld magazine hits, %lld magazine exchanges\n",
+          hit_cnt, swap_cnt);
+}
+
+/* Removes and returns a free block from descriptor D, creating
+   a new arena if no arena has a free block.  Returns a null
+   pointer if memory is not available.
+   D's lock must be held.  It is released while a new arena is
+   allocated. */
+static struct block *
+depot_get (struct desc *d)
+{
+  struct arena *a;
+  struct block *b;
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  /* If no arena has a free block, create a new arena. */
+  if (list_empty (&d->arena_list))
+    {
+      size_t i;
+
+      /* Allocate a page.  Drop the lock meanwhile, because the
+         page allocator may call shrinkers that free blocks.  The
+         arena is shared by every thread that allocates from D, so
+         only its blocks are reported to the profiler. */
+      lock_release (&d->lock);
+      a = palloc_get_page (PAL_NOPROF);
+      lock_acquire (&d->lock);
+      if (a == NULL) 
+        return NULL;
+
+      /* Initialize arena and add its blocks to its free list. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      list_init (&a->free_list);
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_push_back (&a->free_list, &b->free_elem);
+        }
+      list_push_back (&d->arena_list, &a->desc_elem);
+    }
+
+  /* Get a block from the first arena with a free block. */
+  a = list_entry (list_front (&d->arena_list), struct arena, desc_elem);
+  b = list_entry (list_pop_front (&a->free_list), struct block, free_elem);
+  if (--a->free_cnt == 0)
+    list_remove (&a->desc_elem);
+  return b;
+}
+
+/* Returns block B to descriptor D.  If B's arena is then
+   entirely unused, gives the arena back to the page allocator.
+   D's lock must be held. */
+static void
+depot_put (struct desc *d, struct block *b)
+{
+  struct arena *a = block_to_arena (b);
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+  ASSERT (a->desc == d);
+
+  /* Add block to its arena's free list, and the arena to the
+     descriptor's list if this is its first free block. */
+  list_push_front (&a->free_list, &b->free_elem);
+  if (a->free_cnt++ == 0)
+    list_push_front (&d->arena_list, &a->desc_elem);
+
+  /* If the arena is now entirely unused, free it. */
+  if (a->free_cnt >= d->blocks_per_arena) 
+    {
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      list_remove (&a->desc_elem);
+      palloc_free_page (a);
+    }
+}
+
+/* Returns the current thread's magazine for descriptor D,
+   allocating the thread's magazines if it has none yet.
+   Returns a null pointer if memory is not available. */
+static struct malloc_magazine *
+thread_magazine (struct desc *d)
+{
+  struct thread *t = thread_current ();
+  size_t idx = d - descs;
+
+  ASSERT (idx < MALLOC_MAG_CLASSES);
+  ASSERT (d->mag_size > 0);
+
+  if (t->malloc_mags == NULL)
+    {
+      struct malloc_magazine *mags;
+
+      /* Take the block straight from the descriptor, because
+         going through malloc() would need a magazine. */
+      lock_acquire (&mags_desc->lock);
+      mags = (struct malloc_magazine *) depot_get (mags_desc);
+      lock_release (&mags_desc->lock);
+      if (mags == NULL)
+        return NULL;
+
+      memset (mags, 0, sizeof *mags * MALLOC_MAG_CLASSES);
+      t->malloc_mags = mags;
+    }
+  return &t->malloc_mags[idx];
+}
+
+/* Refills empty magazine M with half a magazine's worth of
+   blocks from descriptor D.  Returns true if at least one block
+   was obtained, false if memory is not available. */
+static bool
+magazine_fill (struct desc *d, struct malloc_magazine *m)
+{
+  size_t want = (d->mag_size + 1) / 2;
+
+  ASSERT (m->cnt == 0);
+
+  lock_acquire (&d->lock);
+  while (m->cnt < want)
+    {
+      struct block *b = depot_get (d);
+      if (b == NULL)
+        break;
+      m->rounds[m->cnt++] = b;
+    }
+  d->hit_cnt += m->hit_cnt;
+  d->swap_cnt++;
+  lock_release (&d->lock);
+
+  m->hit_cnt = 0;
+  return m->cnt > 0;
+}
+
+/* Returns the top CNT blocks of magazine M to descriptor D. */
+static void
+magazine_flush (struct desc *d, struct malloc_magazine *m, size_t cnt)
+{
+  ASSERT (cnt <= m->cnt);
+
+  lock_acquire (&d->lock);
+  while (cnt-- > 0)
+    depot_put (d, m->rounds[--m->cnt]);
+  d->hit_cnt += m->hit_cnt;
+  d->swap_cnt++;
+  lock_release (&d->lock);
+
+  m->hit_cnt = 0;
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
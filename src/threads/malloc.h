@@ -2,12 +2,33 @@
 #define THREADS_MALLOC_H
 
 #include <debug.h>
+#include <stdbool.h>
 #include <stddef.h>
 
+/* Per-thread magazine cache.  See malloc.c for details. */
+#define MALLOC_MAG_CLASSES 6    /* Size classes that have magazines. */
+#define MALLOC_MAG_ROUNDS 8     /* Maximum blocks held by a magazine. */
+
+/* A magazine: a small stack of free blocks of one size class
+   owned by a single thread. */
+struct malloc_magazine
+  {
+    unsigned cnt;                       /* Number of blocks held. */
+    unsigned hit_cnt;                   /* Hits not yet counted in desc. */
+    void *rounds[MALLOC_MAG_ROUNDS];    /* Free blocks, top at CNT - 1. */
+  };
+
+/* If true, fill freed blocks with 0xcc to help detect
+   use-after-free bugs.
+   Controlled by kernel command-line option "-poison". */
+extern bool malloc_poison;
+
 void malloc_init (void);
 void *malloc (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
 void free (void *);
+void malloc_thread_exit (void);
+void malloc_print_stats (void);
 
 #endif /* threads/malloc.h */
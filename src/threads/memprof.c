@@ -0,0 +1,386 @@
+#include "threads/memprof.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+/* Allocation profiler.
+
+   When enabled with -memprof, malloc() and the page allocator
+   report every allocation and free here.  We keep a record of
+   each live allocation (its address, size, caller, thread, and
+   the time it was made) in a fixed table, hashed by address, and
+   per-caller totals in a second table of "sites".
+
+   At shutdown we print the sites that allocated the most bytes
+   and the most blocks, and the sites whose allocations are still
+   live.  When a thread exits, we print the allocations it made
+   that it did not free, except those it handed over to another
+   thread or to a shared cache and disowned with memprof_disown(),
+   such as a new thread's page and process control block.  Each
+   report ends with a "Call stack:" line listing the callers in
+   the order printed, which can be passed to the backtrace
+   utility to turn them into function names and line numbers.
+
+   Pages are freed with interrupts off when a thread dies, so the
+   tables are protected by disabling interrupts.  The tables are
+   allocated from the page allocator before profiling starts, so
+   they are not profiled themselves.  If the record table fills
+   up, further allocations are counted but not tracked. */
+
+#define RECORD_CNT 4096         /* Maximum live allocations tracked. */
+#define BUCKET_CNT 1024         /* Hash buckets for records. */
+#define SITE_CNT 256            /* Maximum distinct callers. */
+#define TOP_CNT 10              /* Sites listed in each report. */
+#define EXIT_CNT 8              /* Leaks listed when a thread exits. */
+#define NIL UINT16_MAX          /* Null record index. */
+
+/* A live allocation. */
+struct record
+  {
+    const void *ptr;            /* Allocated block. */
+    void *caller;               /* Return address into allocating code. */
+    uint32_t size;              /* Size in bytes. */
+    uint32_t ticks;             /* timer_ticks() when allocated. */
+    tid_t tid;                  /* Allocating thread. */
+    uint16_t next;              /* Next record in bucket or free list. */
+    uint16_t site;              /* Index of caller's site. */
+  };
+
+/* Totals for one caller. */
+struct site
+  {
+    void *caller;               /* Return address, null if unused. */
+    long long alloc_cnt;        /* Allocations ever made. */
+    long long alloc_bytes;      /* Bytes ever allocated. */
+    size_t live_cnt;            /* Allocations still live. */
+    size_t live_bytes;          /* Bytes still live. */
+  };
+
+bool memprof_enabled;
+
+static bool ready;                      /* Tables set up? */
+static struct record *records;          /* Record table. */
+static uint16_t *buckets;               /* Hash chains of records. */
+static uint16_t free_head;              /* List of unused records. */
+static struct site *sites;              /* SITE_CNT sites + overflow. */
+static long long dropped_cnt;           /* Allocations not tracked. */
+
+static unsigned hash_ptr (const void *);
+static uint16_t *find_record (const void *);
+static uint16_t lookup_site (void *caller);
+static size_t top_sites (long long (*key) (const struct site *),
+                         const struct site *top[TOP_CNT]);
+static void print_sites (const char *title, const struct site *[],
+                         size_t cnt);
+static long long site_bytes (const struct site *);
+static long long site_count (const struct site *);
+static long long site_live (const struct site *);
+
+/* Sets up the profiler's tables, if profiling is enabled.
+   Must be called after palloc_init(). */
+void
+memprof_init (void)
+{
+  size_t bytes, page_cnt, i;
+  uint8_t *p;
+
+  if (!memprof_enabled)
+    return;
+
+  bytes = (RECORD_CNT * sizeof *records + BUCKET_CNT * sizeof *buckets
+           + (SITE_CNT + 1) * sizeof *sites);
+  page_cnt = DIV_ROUND_UP (bytes, PGSIZE);
+  p = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, page_cnt);
+
+  sites = (struct site *) p;
+  records = (struct record *) (sites + SITE_CNT + 1);
+  buckets = (uint16_t *) (records + RECORD_CNT);
+
+  for (i = 0; i < BUCKET_CNT; i++)
+    buckets[i] = NIL;
+  for (i = 0; i < RECORD_CNT; i++)
+    records[i].next = i + 1 < RECORD_CNT ? i + 1 : NIL;
+  free_head = 0;
+
+  printf ("Memory profiling enabled, %zu kB of tables.\n",
+          page_cnt * PGSIZE / 1024);
+  ready = true;
+}
+
+/* Records that CALLER allocated SIZE bytes at P. */
+void
+memprof_alloc (const void *p, size_t size, void *caller)
+{
+  enum intr_level old_level;
+  struct record *r;
+  struct site *s;
+  uint16_t idx;
+  unsigned h;
+
+  if (!ready || p == NULL)
+    return;
+
+  old_level = intr_disable ();
+  idx = lookup_site (caller);
+  s = &sites[idx];
+  s->alloc_cnt++;
+  s->alloc_bytes += size;
+  if (free_head != NIL)
+    {
+      r = &records[free_head];
+      free_head = r->next;
+
+      r->ptr = p;
+      r->caller = caller;
+      r->size = size;
+      r->ticks = timer_ticks ();
+      r->tid = thread_tid ();
+      r->site = idx;
+
+      h = hash_ptr (p);
+      r->next = buckets[h];
+      buckets[h] = r - records;
+
+      s->live_cnt++;
+      s->live_bytes += size;
+    }
+  else
+    dropped_cnt++;
+  intr_set_level (old_level);
+}
+
+/* Records that the allocation at P was freed. */
+void
+memprof_free (const void *p)
+{
+  enum intr_level old_level;
+  uint16_t *idxp;
+
+  if (!ready || p == NULL)
+    return;
+
+  old_level = intr_disable ();
+  idxp = find_record (p);
+  if (idxp != NULL)
+    {
+      struct record *r = &records[*idxp];
+      struct site *s = &sites[r->site];
+      s->live_cnt--;
+      s->live_bytes -= r->size;
+
+      *idxp = r->next;
+      r->ptr = NULL;
+      r->next = free_head;
+      free_head = r - records;
+    }
+  intr_set_level (old_level);
+}
+
+/* Records that the allocation at P no longer belongs to the
+   thread that made it, so that it is not reported as a leak
+   when that thread exits.  It is still counted as live until it
+   is freed. */
+void
+memprof_disown (const void *p)
+{
+  enum intr_level old_level;
+  uint16_t *idxp;
+
+  if (!ready || p == NULL)
+    return;
+
+  old_level = intr_disable ();
+  idxp = find_record (p);
+  if (idxp != NULL)
+    records[*idxp].tid = TID_ERROR;
+  intr_set_level (old_level);
+}
+
+/* Reports the allocations that the running thread made and did
+   not free.  Called when a thread exits. */
+void
+memprof_thread_exit (void)
+{
+  struct record leaks[EXIT_CNT];
+  enum intr_level old_level;
+  size_t leak_cnt = 0, leak_bytes = 0;
+  tid_t tid = thread_tid ();
+  int64_t now = timer_ticks ();
+  size_t i;
+
+  if (!ready)
+    return;
+
+  old_level = intr_disable ();
+  for (i = 0; i < RECORD_CNT; i++)
+    if (records[i].ptr != NULL && records[i].tid == tid)
+      {
+        if (leak_cnt < EXIT_CNT)
+          leaks[leak_cnt] = records[i];
+        leak_cnt++;
+        leak_bytes += records[i].size;
+      }
+  intr_set_level (old_level);
+
+  if (leak_cnt == 0)
+    return;
+
+  printf ("Memprof: thread `%s' exited with %zu allocations "
+          "(%zu bytes) live:\n", thread_name (), leak_cnt, leak_bytes);
+  for (i = 0; i < leak_cnt && i < EXIT_CNT; i++)
+    printf ("Memprof:  #%zu %p: %u bytes, %lld ticks old, from %p\n",
+            i, leaks[i].ptr, (unsigned) leaks[i].size,
+            (long long) (now - leaks[i].ticks), leaks[i].caller);
+  printf ("Call stack:");
+  for (i = 0; i < leak_cnt && i < EXIT_CNT; i++)
+    printf (" %p", leaks[i].caller);
+  printf (".\n");
+}
+
+/* Prints the allocation sites that used the most memory, and
+   those whose allocations are still live. */
+void
+memprof_print_stats (void)
+{
+  const struct site *top[TOP_CNT];
+  size_t live_cnt = 0, live_bytes = 0;
+  size_t site_cnt = 0;
+  size_t i;
+
+  if (!ready)
+    return;
+
+  for (i = 0; i <= SITE_CNT; i++)
+    if (sites[i].alloc_cnt > 0)
+      {
+        site_cnt++;
+        live_cnt += sites[i].live_cnt;
+        live_bytes += sites[i].live_bytes;
+      }
+  printf ("Memprof: %zu allocation sites, %lld allocations not tracked\n",
+          site_cnt, dropped_cnt);
+
+  print_sites ("top sites by bytes", top, top_sites (site_bytes, top));
+  print_sites ("top sites by count", top, top_sites (site_count, top));
+  printf ("Memprof: %zu allocations (%zu bytes) live at shutdown\n",
+          live_cnt, live_bytes);
+  print_sites ("top sites by live bytes", top, top_sites (site_live, top));
+}
+
+/* Returns a hash bucket index for P. */
+static unsigned
+hash_ptr (const void *p)
+{
+  uintptr_t x = (uintptr_t) p;
+  return ((x >> 4) ^ (x >> PGBITS)) % BUCKET_CNT;
+}
+
+/* Returns the link that points to the record for P, or a null
+   pointer if P is not tracked.  Interrupts must be off. */
+static uint16_t *
+find_record (const void *p)
+{
+  uint16_t *idxp;
+
+  for (idxp = &buckets[hash_ptr (p)]; *idxp != NIL;
+       idxp = &records[*idxp].next)
+    if (records[*idxp].ptr == p)
+      return idxp;
+  return NULL;
+}
+
+/* Returns the index of the site for CALLER, creating it if
+   necessary.  If the site table is full, returns the overflow
+   site.  Interrupts must be off. */
+static uint16_t
+lookup_site (void *caller)
+{
+  unsigned h = ((uintptr_t) caller >> 2) % SITE_CNT;
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = 0; i < SITE_CNT; i++, h = (h + 1) % SITE_CNT)
+    {
+      if (sites[h].caller == caller)
+        return h;
+      if (sites[h].caller == NULL)
+        {
+          sites[h].caller = caller;
+          return h;
+        }
+    }
+  return SITE_CNT;
+}
+
+/* Stores in TOP the sites with the largest nonzero values of
+   KEY, largest first, and returns how many were stored. */
+static size_t
+top_sites (long long (*key) (const struct site *),
+           const struct site *top[TOP_CNT])
+{
+  size_t cnt = 0;
+  size_t i, j;
+
+  for (i = 0; i <= SITE_CNT; i++)
+    {
+      const struct site *s = &sites[i];
+      long long k = key (s);
+
+      if (k <= 0 || (cnt == TOP_CNT && k <= key (top[cnt - 1])))
+        continue;
+      if (cnt < TOP_CNT)
+        cnt++;
+      for (j = cnt - 1; j > 0 && key (top[j - 1]) < k; j--)
+        top[j] = top[j - 1];
+      top[j] = s;
+    }
+  return cnt;
+}
+
+/* Prints the CNT sites in TOP under TITLE, followed by their
+   callers as a call stack for the backtrace utility. */
+static void
+print_sites (const char *title, const struct site *top[], size_t cnt)
+{
+  size_t i;
+
+  if (cnt == 0)
+    return;
+
+  printf ("Memprof: %s:\n", title);
+  for (i = 0; i < cnt; i++)
+    printf ("Memprof:  #%zu %p: %lld allocations (%lld bytes), "
+            "%zu live (%zu bytes)\n", i, top[i]->caller,
+            top[i]->alloc_cnt, top[i]->alloc_bytes,
+            top[i]->live_cnt, top[i]->live_bytes);
+  printf ("Call stack:");
+  for (i = 0; i < cnt; i++)
+    printf (" %p", top[i]->caller);
+  printf (".\n");
+}
+
+/* Sort keys for top_sites(). */
+static long long
+site_bytes (const struct site *s)
+{
+  return s->alloc_bytes;
+}
+
+static long long
+site_count (const struct site *s)
+{
+  return s->alloc_cnt;
+}
+
+static long long
+site_live (const struct site *s)
+{
+  return s->live_bytes;
+}
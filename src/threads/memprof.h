@@ -0,0 +1,18 @@
+#ifndef THREADS_MEMPROF_H
+#define THREADS_MEMPROF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* If true, record every live malloc() and palloc allocation.
+   Controlled by kernel command-line option "-memprof". */
+extern bool memprof_enabled;
+
+void memprof_init (void);
+void memprof_alloc (const void *, size_t size, void *caller);
+void memprof_free (const void *);
+void memprof_disown (const void *);
+void memprof_thread_exit (void);
+void memprof_print_stats (void);
+
+#endif /* threads/memprof.h */
@@ -7,7 +7,9 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/memprof.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -15,33 +17,99 @@
    page-multiple) chunks.  See malloc.h for an allocator that
    hands out smaller chunks.
 
-   System memory is divided into two "pools" called the kernel
-   and user pools.  The user pool is for user (virtual) memory
-   pages, the kernel pool for everything else.  The idea here is
-   that the kernel needs to have memory for its own operations
-   even if user processes are swapping like mad.
+   All free memory is managed by a single bitmap, but every page
+   in use is charged to one of two "pools" called the kernel and
+   user pools.  The user pool is for user (virtual) memory pages,
+   the kernel pool for everything else.
 
-   By default, half of system RAM is given to the kernel pool and
-   half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   Each pool has a soft quota.  By default, half of system RAM
+   is the kernel pool's quota and half the user pool's.  A pool
+   may always grow up to its quota.  Beyond that it borrows free
+   pages from the other pool, but only as long as the other pool
+   keeps a reserve of free pages (1/8 of its quota, or whatever
+   it has left of its quota, if less).  Borrowed pages return to
+   the common bitmap when they are freed, so the lending pool
+   gets them back as soon as the borrower lets go.  The idea is
+   that the kernel still has memory for its own operations even
+   if user processes are swapping like mad, without leaving half
+   of RAM idle when only one side is busy.  The user pool also
+   has a hard limit, set with the -ul option, that it never
+   exceeds.
 
-/* A memory pool. */
+   Kernel pages are searched for from the bottom of memory and
+   user pages from the boundary between the two quotas, so that
+   each pool's pages stay mostly together.
+
+   The allocator also keeps a small stack of free pages that the
+   idle thread has already filled with zeros, so that single-page
+   PAL_ZERO requests do not have to clear a page on the caller's
+   critical path.  Pages on the stack are marked used in the
+   bitmap but are not charged to either pool.  The idle thread
+   refills the stack up to its watermark whenever nothing else is
+   ready to run, and the stack is given back to the bitmap if an
+   allocation would otherwise fail.
+
+   Before a request finally fails, the allocator also calls the
+   registered shrinkers (see palloc.h), which give back memory
+   held by kernel caches, and then tries once more. */
+
+/* Maximum number of pre-zeroed pages. */
+#define ZERO_PAGES_MAX 128
+
+/* A pool's reserve is 1/RESERVE_DIV of its quota. */
+#define RESERVE_DIV 8
+
+/* Minimum number of objects to ask each shrinker to free. */
+#define SHRINK_BATCH 8
+
+/* A memory pool: the pages charged to kernel or user use. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
-    uint8_t *base;                      /* Base of pool. */
+    const char *name;                   /* Name, for statistics. */
+    size_t quota;                       /* Soft limit on pages. */
+    size_t limit;                       /* Hard limit on pages. */
+    size_t used;                        /* Pages currently charged. */
+    size_t hint;                        /* Where to start searching. */
+    long long borrow_cnt;               /* # of pages borrowed. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
-static void init_pool (struct pool *, void *base, size_t page_cnt,
-                       const char *name);
-static bool page_from_pool (const struct pool *, void *page);
+/* Physical pages.  Counters are updated with interrupts off,
+   because pages may be freed with interrupts off. */
+static struct lock lock;                /* Mutual exclusion. */
+static struct bitmap *used_map;         /* Bitmap of used pages. */
+static struct bitmap *user_map;         /* Pages charged to user_pool. */
+static uint8_t *base;                   /* Base of free memory. */
+static size_t free_cnt;                 /* Pages free in USED_MAP. */
+
+/* Pre-zeroed pages.  Protected by disabling interrupts, so that
+   the stack may be used from any context. */
+static void *zero_pages[ZERO_PAGES_MAX]; /* Stack of zeroed pages. */
+static size_t zero_cnt;                  /* Number of pages on stack. */
+static size_t zero_watermark;            /* Refill up to this many. */
+
+/* Registered shrinkers.  Only changed during initialization,
+   so it needs no lock. */
+static struct list shrinkers;
+
+static void *alloc_pages (enum palloc_flags, size_t page_cnt);
+static void *get_pages (struct pool *, enum palloc_flags, size_t page_cnt);
+static bool run_shrinkers (size_t page_cnt);
+static bool may_charge (const struct pool *, size_t page_cnt);
+static void charge (struct pool *, size_t page_idx, size_t page_cnt);
+static bool page_from_pool (void *page);
+static void *pop_zero_page (void);
+static bool drain_zero_pages (void);
+static bool refill_zero_page (void);
+
+/* Statistics. */
+static long long zero_hit_cnt;  /* # of PAL_ZERO pages from the stack. */
+static long long zero_miss_cnt; /* # of PAL_ZERO pages cleared inline. */
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
-   pages are put into the user pool. */
+   pages are ever charged to the user pool. */
 void
 palloc_init (size_t user_page_limit)
 {
@@ -49,134 +117,447 @@ palloc_init (size_t user_page_limit)
   uint8_t *free_start = ptov (1024 * 1024);
   uint8_t *free_end = ptov (init_ram_pages * PGSIZE);
   size_t free_pages = (free_end - free_start) / PGSIZE;
-  size_t user_pages = free_pages / 2;
-  size_t kernel_pages;
-  if (user_pages > user_page_limit)
-    user_pages = user_page_limit;
-  kernel_pages = free_pages - user_pages;
+  size_t bm_pages;
+
+  /* We'll put the bitmaps at the base of free memory.
+     Calculate the space needed for them and subtract it from
+     the number of free pages. */
+  bm_pages = DIV_ROUND_UP (2 * bitmap_buf_size (free_pages), PGSIZE);
+  if (bm_pages > free_pages)
+    PANIC ("Not enough memory for page allocator bitmaps.");
+  free_pages -= bm_pages;
+
+  lock_init (&lock);
+  list_init (&shrinkers);
+  used_map = bitmap_create_in_buf (free_pages, free_start,
+                                   bitmap_buf_size (free_pages));
+  user_map = bitmap_create_in_buf (free_pages,
+                                   free_start + bitmap_buf_size (free_pages),
+                                   bitmap_buf_size (free_pages));
+  base = free_start + bm_pages * PGSIZE;
+  free_cnt = free_pages;
 
   /* Give half of memory to kernel, half to user. */
-  init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
-  init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
-             user_pages, "user pool");
+  user_pool.name = "user pool";
+  user_pool.quota = free_pages / 2;
+  if (user_pool.quota > user_page_limit)
+    user_pool.quota = user_page_limit;
+  user_pool.limit = user_page_limit;
+  user_pool.hint = free_pages - user_pool.quota;
+
+  kernel_pool.name = "kernel pool";
+  kernel_pool.quota = free_pages - user_pool.quota;
+  kernel_pool.limit = SIZE_MAX;
+  kernel_pool.hint = 0;
+
+  printf ("%zu pages available in kernel pool.\n", kernel_pool.quota);
+  printf ("%zu pages available in user pool.\n", user_pool.quota);
+
+  zero_watermark = free_pages / 32;
+  if (zero_watermark > ZERO_PAGES_MAX)
+    zero_watermark = ZERO_PAGES_MAX;
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
-   If PAL_USER is set, the pages are obtained from the user pool,
-   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
+   If PAL_USER is set, the pages are charged to the user pool,
+   otherwise to the kernel pool.  If PAL_ZERO is set in FLAGS,
    then the pages are filled with zeros.  If too few pages are
    available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
+   FLAGS, in which case the kernel panics.  If PAL_NOPROF is set,
+   the pages are not reported to the memory profiler, because the
+   caller reports their contents itself. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
+{
+  void *pages = alloc_pages (flags, page_cnt);
+  if (!(flags & PAL_NOPROF))
+    memprof_alloc (pages, page_cnt * PGSIZE,
+                   __builtin_return_address (0));
+  return pages;
+}
+
+/* Does the work of palloc_get_multiple(), without profiling. */
+static void *
+alloc_pages (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void *pages;
-  size_t page_idx;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  pages = get_pages (pool, flags, page_cnt);
+  while (pages == NULL && run_shrinkers (page_cnt))
+    pages = get_pages (pool, flags, page_cnt);
 
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
-  else
-    pages = NULL;
-
-  if (pages != NULL) 
-    {
-      if (flags & PAL_ZERO)
-        memset (pages, 0, PGSIZE * page_cnt);
-    }
-  else 
-    {
-      if (flags & PAL_ASSERT)
-        PANIC ("palloc_get: out of pages");
-    }
+  if (pages == NULL && (flags & PAL_ASSERT))
+    PANIC ("palloc_get: out of pages");
 
   return pages;
 }
 
 /* Obtains a single free page and returns its kernel virtual
    address.
-   If PAL_USER is set, the page is obtained from the user pool,
-   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
+   If PAL_USER is set, the page is charged to the user pool,
+   otherwise to the kernel pool.  If PAL_ZERO is set in FLAGS,
    then the page is filled with zeros.  If no pages are
    available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
+   FLAGS, in which case the kernel panics.  PAL_NOPROF is as for
+   palloc_get_multiple(). */
 void *
-palloc_get_page (enum palloc_flags flags) 
+palloc_get_page (enum palloc_flags flags)
 {
-  return palloc_get_multiple (flags, 1);
+  void *page = alloc_pages (flags, 1);
+  if (!(flags & PAL_NOPROF))
+    memprof_alloc (page, PGSIZE, __builtin_return_address (0));
+  return page;
+}
+
+/* Adds SHRINKER to the shrinkers that the page allocator calls
+   when it runs out of memory.  Must be called during
+   initialization, after palloc_init(). */
+void
+palloc_register_shrinker (struct shrinker *shrinker)
+{
+  ASSERT (shrinker->count != NULL && shrinker->shrink != NULL);
+  list_push_back (&shrinkers, &shrinker->elem);
+}
+
+/* Returns the number of pages that could be allocated with
+   PAL_USER right now, counting those the user pool may borrow
+   from the kernel pool.  The count may be stale by the time the
+   caller looks at it. */
+size_t
+palloc_user_free (void)
+{
+  size_t reserve = 0;
+  size_t avail;
+
+  if (kernel_pool.used < kernel_pool.quota)
+    {
+      reserve = kernel_pool.quota - kernel_pool.used;
+      if (reserve > kernel_pool.quota / RESERVE_DIV)
+        reserve = kernel_pool.quota / RESERVE_DIV;
+    }
+  avail = free_cnt > reserve ? free_cnt - reserve : 0;
+  if (user_pool.used < user_pool.quota
+      && user_pool.quota - user_pool.used > avail)
+    avail = user_pool.quota - user_pool.used;
+  if (avail > free_cnt)
+    avail = free_cnt;
+  if (avail > user_pool.limit - user_pool.used)
+    avail = user_pool.limit - user_pool.used;
+  return avail;
+}
+
+/* Zeroes one free page in the background, if the zeroed stack
+   is below its watermark.  Returns true if more pages could be
+   zeroed, false if the stack is full or the allocator is busy.
+   Called by the idle thread, so it never sleeps. */
+bool
+palloc_zero_idle (void)
+{
+  return refill_zero_page ();
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void)
+{
+  const struct pool *pools[] = {&kernel_pool, &user_pool};
+  struct list_elem *e;
+  size_t i;
+
+  for (i = 0; i < sizeof pools / sizeof *pools; i++)
+    {
+      const struct pool *p = pools[i];
+      printf ("Palloc: %s %zu of %zu pages used, %zu borrowed now, "
+              "%lld borrowed in total\n", p->name, p->used, p->quota,
+              p->used > p->quota ? p->used - p->quota : 0, p->borrow_cnt);
+    }
+  printf ("Palloc: %zu pages free, %lld zeroed page hits, %lld misses\n",
+          free_cnt, zero_hit_cnt, zero_miss_cnt);
+  for (e = list_begin (&shrinkers); e != list_end (&shrinkers);
+       e = list_next (e))
+    {
+      struct shrinker *sh = list_entry (e, struct shrinker, elem);
+      printf ("Palloc: %s shrinker %zu cached, %lld freed\n",
+              sh->name, sh->count (), sh->shrunk_cnt);
+    }
 }
 
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
-palloc_free_multiple (void *pages, size_t page_cnt) 
+palloc_free_multiple (void *pages, size_t page_cnt)
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
     return;
 
-  if (page_from_pool (&kernel_pool, pages))
-    pool = &kernel_pool;
-  else if (page_from_pool (&user_pool, pages))
-    pool = &user_pool;
-  else
-    NOT_REACHED ();
+  memprof_free (pages);
 
-  page_idx = pg_no (pages) - pg_no (pool->base);
+  ASSERT (page_from_pool (pages));
+  page_idx = pg_no (pages) - pg_no (base);
+  pool = bitmap_test (user_map, page_idx) ? &user_pool : &kernel_pool;
 
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  ASSERT (bitmap_all (used_map, page_idx, page_cnt));
+  ASSERT (pool == &user_pool
+          ? bitmap_all (user_map, page_idx, page_cnt)
+          : bitmap_none (user_map, page_idx, page_cnt));
+
+  old_level = intr_disable ();
+  bitmap_set_multiple (user_map, page_idx, page_cnt, false);
+  bitmap_set_multiple (used_map, page_idx, page_cnt, false);
+  pool->used -= page_cnt;
+  free_cnt += page_cnt;
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
 void
-palloc_free_page (void *page) 
+palloc_free_page (void *page)
 {
   palloc_free_multiple (page, 1);
 }
 
-/* Initializes pool P as starting at START and ending at END,
-   naming it NAME for debugging purposes. */
+/* Tries once to obtain PAGE_CNT contiguous free pages for POOL,
+   as described for palloc_get_multiple(), and returns them, or
+   a null pointer on failure. */
+static void *
+get_pages (struct pool *pool, enum palloc_flags flags, size_t page_cnt)
+{
+  void *pages = NULL;
+  size_t page_idx = BITMAP_ERROR;
+  bool clear = false;
+
+  lock_acquire (&lock);
+  if (page_cnt == 1 && (flags & PAL_ZERO))
+    {
+      if (may_charge (pool, 1))
+        pages = pop_zero_page ();
+      if (pages != NULL)
+        {
+          zero_hit_cnt++;
+          page_idx = pg_no (pages) - pg_no (base);
+        }
+      else
+        zero_miss_cnt++;
+    }
+
+  if (pages == NULL)
+    {
+      if (!may_charge (pool, page_cnt))
+        drain_zero_pages ();
+      if (may_charge (pool, page_cnt))
+        {
+          page_idx = bitmap_scan_and_flip (used_map, pool->hint, page_cnt,
+                                           false);
+          if (page_idx == BITMAP_ERROR)
+            page_idx = bitmap_scan_and_flip (used_map, 0, page_cnt, false);
+          if (page_idx == BITMAP_ERROR && drain_zero_pages ())
+            page_idx = bitmap_scan_and_flip (used_map, 0, page_cnt, false);
+        }
+      if (page_idx != BITMAP_ERROR)
+        {
+          pages = base + PGSIZE * page_idx;
+          clear = (flags & PAL_ZERO) != 0;
+        }
+    }
+
+  if (pages != NULL)
+    charge (pool, page_idx, page_cnt);
+  lock_release (&lock);
+
+  if (clear)
+    memset (pages, 0, PGSIZE * page_cnt);
+
+  return pages;
+}
+
+/* Asks every shrinker to free some of its objects, since an
+   allocation of PAGE_CNT pages has just failed.  Returns true
+   if any shrinker freed anything, false if none could. */
+static bool
+run_shrinkers (size_t page_cnt)
+{
+  size_t want = page_cnt > SHRINK_BATCH ? page_cnt : SHRINK_BATCH;
+  bool progress = false;
+  struct list_elem *e;
+
+  ASSERT (!lock_held_by_current_thread (&lock));
+
+  for (e = list_begin (&shrinkers); e != list_end (&shrinkers);
+       e = list_next (e))
+    {
+      struct shrinker *sh = list_entry (e, struct shrinker, elem);
+      size_t freed = sh->shrink (want);
+      if (freed > 0)
+        {
+          sh->shrunk_cnt += freed;
+          progress = true;
+        }
+    }
+  return progress;
+}
+
+/* Returns true if PAGE_CNT more pages may be charged to POOL,
+   false if that would exceed its hard limit or eat into the
+   other pool's reserve.  Pages on the zeroed stack count as
+   in use.  The allocator lock must be held. */
+static bool
+may_charge (const struct pool *pool, size_t page_cnt)
+{
+  const struct pool *other = pool == &user_pool ? &kernel_pool : &user_pool;
+  size_t reserve;
+
+  ASSERT (lock_held_by_current_thread (&lock));
+
+  if (pool->used + page_cnt > pool->limit)
+    return false;
+  if (pool->used + page_cnt <= pool->quota)
+    return true;
+
+  /* Borrowing: leave the other pool its reserve. */
+  reserve = 0;
+  if (other->used < other->quota)
+    {
+      reserve = other->quota - other->used;
+      if (reserve > other->quota / RESERVE_DIV)
+        reserve = other->quota / RESERVE_DIV;
+    }
+  return free_cnt >= page_cnt + reserve;
+}
+
+/* Charges the PAGE_CNT pages starting at index PAGE_IDX, which
+   have just been marked used, to POOL.  The allocator lock must
+   be held. */
 static void
-init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
+charge (struct pool *pool, size_t page_idx, size_t page_cnt)
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  enum intr_level old_level;
+  size_t borrowed;
 
-  printf ("%zu pages available in %s.\n", page_cnt, name);
+  ASSERT (lock_held_by_current_thread (&lock));
 
-  /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  old_level = intr_disable ();
+  if (pool == &user_pool)
+    bitmap_set_multiple (user_map, page_idx, page_cnt, true);
+  borrowed = pool->used + page_cnt > pool->quota
+             ? pool->used + page_cnt - pool->quota : 0;
+  pool->borrow_cnt += borrowed < page_cnt ? borrowed : page_cnt;
+  pool->used += page_cnt;
+  free_cnt -= page_cnt;
+  intr_set_level (old_level);
 }
 
-/* Returns true if PAGE was allocated from POOL,
+/* Returns true if PAGE was allocated by the page allocator,
    false otherwise. */
 static bool
-page_from_pool (const struct pool *pool, void *page) 
+page_from_pool (void *page)
 {
   size_t page_no = pg_no (page);
-  size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t start_page = pg_no (base);
+  size_t end_page = start_page + bitmap_size (used_map);
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Pops a pre-zeroed page from the stack and returns it, or
+   returns a null pointer if the stack is empty.  The page stays
+   marked used but is not yet charged to any pool. */
+static void *
+pop_zero_page (void)
+{
+  enum intr_level old_level;
+  void *page = NULL;
+
+  old_level = intr_disable ();
+  if (zero_cnt > 0)
+    page = zero_pages[--zero_cnt];
+  intr_set_level (old_level);
+
+  return page;
+}
+
+/* Returns every page on the zeroed stack to the bitmap.
+   Returns true if any pages were returned.  The allocator lock
+   must be held. */
+static bool
+drain_zero_pages (void)
+{
+  enum intr_level old_level;
+  bool drained = false;
+  void *page;
+
+  ASSERT (lock_held_by_current_thread (&lock));
+
+  while ((page = pop_zero_page ()) != NULL)
+    {
+      old_level = intr_disable ();
+      bitmap_reset (used_map, pg_no (page) - pg_no (base));
+      free_cnt++;
+      intr_set_level (old_level);
+      drained = true;
+    }
+  return drained;
+}
+
+/* Takes one free page, zeroes it, and pushes it on the zeroed
+   stack.  Returns true if successful, false if the stack is
+   already at its watermark, memory is short, or the allocator
+   lock is busy.  Only the idle thread may call this
+   function.
+
+   The idle thread is never put back on the ready list when it
+   is preempted, so it must not hold the allocator lock across a
+   preemption, or every other allocating thread would wait for
+   the system to go idle again.  We therefore take the lock,
+   claim the page, and drop the lock again all with interrupts
+   off.  A single-bit scan is short enough for that. */
+static bool
+refill_zero_page (void)
+{
+  enum intr_level old_level;
+  size_t page_idx;
+  void *page;
+
+  old_level = intr_disable ();
+  if (zero_cnt >= zero_watermark || !lock_try_acquire (&lock))
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+
+  /* Don't hoard pages that a pool may need soon. */
+  page_idx = BITMAP_ERROR;
+  if (free_cnt > zero_watermark + kernel_pool.quota / RESERVE_DIV)
+    page_idx = bitmap_scan_and_flip (used_map, 0, 1, false);
+  if (page_idx != BITMAP_ERROR)
+    free_cnt--;
+  lock_release (&lock);
+  intr_set_level (old_level);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  /* The page is marked used, so nobody else can touch it while
+     we clear it. */
+  page = base + PGSIZE * page_idx;
+  memset (page, 0, PGSIZE);
+
+  /* Only the idle thread pushes, so the stack cannot have
+     filled up while we were clearing the page. */
+  old_level = intr_disable ();
+  ASSERT (zero_cnt < ZERO_PAGES_MAX);
+  zero_pages[zero_cnt++] = page;
+  intr_set_level (old_level);
+
+  return true;
+}
@@ -1,6 +1,8 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <list.h>
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -8,13 +10,40 @@ enum palloc_flags
   {
     PAL_ASSERT = 001,           /* Panic on failure. */
     PAL_ZERO = 002,             /* Zero page contents. */
-    PAL_USER = 004              /* User page. */
+    PAL_USER = 004,             /* User page. */
+    PAL_NOPROF = 010            /* Do not report to the profiler. */
+  };
+
+/* A shrinker: a cache that can give memory back to the page
+   allocator under pressure.  When an allocation fails, the page
+   allocator asks each registered shrinker to free some of the
+   objects it caches and then tries again.
+
+   SHRINK may be called from any thread that allocates pages,
+   perhaps while that thread holds locks of its own, so it must
+   not wait for a lock that such a thread may hold: it should
+   take its cache's locks with lock_try_acquire() and give up if
+   that fails.  It may release memory with free() and
+   palloc_free_page(), even though free() may wait on a malloc()
+   descriptor's lock, because malloc() and vmalloc() never hold
+   their locks while they call the page allocator. */
+struct shrinker
+  {
+    const char *name;               /* Name, for statistics. */
+    size_t (*count) (void);         /* Returns # of cached objects. */
+    size_t (*shrink) (size_t cnt);  /* Frees up to CNT, returns # freed. */
+    long long shrunk_cnt;           /* # of objects freed so far. */
+    struct list_elem elem;          /* List element. */
   };
 
 void palloc_init (size_t user_page_limit);
+void palloc_register_shrinker (struct shrinker *);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+size_t palloc_user_free (void);
+bool palloc_zero_idle (void);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
@@ -7,6 +7,8 @@
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/malloc.h"
+#include "threads/memprof.h"
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
@@ -38,6 +40,15 @@ static struct thread *initial_thread;
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
+/* Pages of dead threads, kept for reuse by thread_create().
+   Protected by disabling interrupts, because dead threads are
+   freed with interrupts off.  Given back to the page allocator
+   by thread_page_shrinker under memory pressure. */
+#define THREAD_PAGE_CACHE_MAX 8
+static void *thread_page_cache[THREAD_PAGE_CACHE_MAX];
+static size_t thread_page_cache_cnt;
+static struct shrinker thread_page_shrinker;
+
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame
   {
@@ -85,6 +96,10 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void *thread_page_pop (void);
+static void thread_page_put (void *);
+static size_t thread_page_count (void);
+static size_t thread_page_shrink (size_t cnt);
 
 #ifndef USERPROG
 static void thread_aging (void);
@@ -153,6 +168,12 @@ thread_init (void)
 void
 thread_start (void)
 {
+  /* Let the page allocator reclaim cached thread pages. */
+  thread_page_shrinker.name = "thread page";
+  thread_page_shrinker.count = thread_page_count;
+  thread_page_shrinker.shrink = thread_page_shrink;
+  palloc_register_shrinker (&thread_page_shrinker);
+
   /* Create the idle thread. */
   struct semaphore idle_started;
   sema_init (&idle_started, 0);
@@ -231,15 +252,23 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = thread_page_pop ();
+  if (t == NULL)
+    t = palloc_get_page (PAL_ZERO);
   if (t == NULL)
     return TID_ERROR;
 
+  /* The page belongs to the new thread, not to us. */
+  memprof_disown (t);
+
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
   t->nice = thread_current ()->nice;
   t->recent_cpu = thread_current ()->recent_cpu;
+#ifdef VM
+  t->rss_limit = thread_current ()->rss_limit;
+#endif
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -257,13 +286,23 @@ thread_create (const char *name, int priority,
   sf->ebp = 0;
 
 #ifdef USERPROG
-  /* Create a process control block. */
-  pcb = palloc_get_page (PAL_ZERO);
+  /* Create a process control block.  It is small, so it comes
+     from malloc() rather than taking a page of its own.  If that
+     fails, the new thread never ran, so we release its page here. */
+  pcb = malloc (sizeof *pcb);
   if (pcb == NULL)
-    return TID_ERROR;
+    {
+      enum intr_level old_level = intr_disable ();
+      list_remove (&t->allelem);
+      intr_set_level (old_level);
+      palloc_free_page (t);
+      return TID_ERROR;
+    }
+  memprof_disown (pcb);
 
   pcb->pid = (pid_t) tid;
   pcb->alive = true;
+  pcb->orphan = false;
   pcb->being_waited = false;
   pcb->start_success = false;
   pcb->exit_status = -1;
@@ -386,6 +425,12 @@ thread_exit (void)
   process_exit ();
 #endif
 
+  /* Give the blocks cached in our malloc() magazines back. */
+  malloc_thread_exit ();
+
+  /* Report any memory we allocated and never freed. */
+  memprof_thread_exit ();
+
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
@@ -645,6 +690,11 @@ idle (void *idle_started_ UNUSED)
 
   for (;;)
     {
+      /* Use the spare time to zero free pages for palloc, until
+         some other thread becomes ready. */
+      while (list_empty (&ready_list) && palloc_zero_idle ())
+        continue;
+
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
@@ -719,15 +769,20 @@ init_thread (struct thread *t, const char *name, int priority)
   t->magic = THREAD_MAGIC;
 
 #ifdef USERPROG
-  /* Initialize a list of process control blocks of children and files
-     and a pointer to the ELF executable.
+  /* Initialize a list of process control blocks of children, a
+     table of open files and a pointer to the ELF executable.
 
      Initialization must be done here because even main thread can have
      children and open files. Only main thread doesn't have ELF executable. */
   list_init (&t->children);
-  list_init (&t->files);
+  t->files = NULL;
+  t->file_cnt = 0;
+  t->free_fd = 2;
   t->elf_executable = NULL;
 #endif
+#ifdef VM
+  list_init (&t->mappings);
+#endif
 
   old_level = intr_disable ();
   list_push_back (&all_list, &t->allelem);
@@ -806,7 +861,7 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread)
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      thread_page_put (prev);
     }
 }
 
@@ -833,6 +888,62 @@ schedule (void)
   thread_schedule_tail (prev);
 }
 
+/* Returns the page of a dead thread for reuse, or a null
+   pointer if none is cached.  Only the struct thread at the
+   bottom of the page needs to be clean, and init_thread()
+   clears that. */
+static void *
+thread_page_pop (void)
+{
+  enum intr_level old_level;
+  void *page = NULL;
+
+  old_level = intr_disable ();
+  if (thread_page_cache_cnt > 0)
+    page = thread_page_cache[--thread_page_cache_cnt];
+  intr_set_level (old_level);
+
+  return page;
+}
+
+/* Caches PAGE, the page of a dead thread, for reuse, or frees
+   it if the cache is full.  Called with interrupts off. */
+static void
+thread_page_put (void *page)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_page_cache_cnt < THREAD_PAGE_CACHE_MAX)
+    thread_page_cache[thread_page_cache_cnt++] = page;
+  else
+    palloc_free_page (page);
+}
+
+/* Returns the number of cached thread pages. */
+static size_t
+thread_page_count (void)
+{
+  return thread_page_cache_cnt;
+}
+
+/* Frees up to CNT cached thread pages and returns the number
+   freed. */
+static size_t
+thread_page_shrink (size_t cnt)
+{
+  size_t freed = 0;
+
+  while (freed < cnt)
+    {
+      void *page = thread_page_pop ();
+      if (page == NULL)
+        break;
+      palloc_free_page (page);
+      freed++;
+    }
+  return freed;
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid (void)
@@ -4,6 +4,7 @@
 #include <debug.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/malloc.h"
 #ifndef USERPROG
 #include "threads/synch.h"
 #endif
@@ -116,6 +117,9 @@ struct thread
     struct list_elem sleep_elem;        /* List element for sleep list. */
     struct list_elem allelem;           /* List element for all threads list. */
 
+    /* Owned by threads/malloc.c. */
+    struct malloc_magazine *malloc_mags; /* Magazines, null until used. */
+
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
 
@@ -124,9 +128,29 @@ struct thread
     uint32_t *pagedir;                  /* Page directory. */
     struct file *elf_executable;        /* A file that is being executed. */
     struct list children;               /* A list of children processes. */
-    struct list files;                  /* A list of files. */
+    struct file **files;                /* Open files, indexed by fd. */
+    int file_cnt;                       /* Number of slots in FILES. */
+    int free_fd;                        /* No lower fd is free. */
     struct process *pcb;                /* A process control block. */
 #endif
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct hash *pages;                 /* Supplemental page table. */
+    void *user_esp;                     /* User esp on system call entry. */
+    uint8_t *ra_start;                  /* First page read ahead. */
+    uint8_t *ra_next;                   /* Page after last read ahead. */
+    size_t ra_window;                   /* Pages to read ahead next. */
+    size_t wss;                         /* Working set estimate, pages. */
+    int64_t wss_sampled;                /* Timer ticks at last sample. */
+
+    /* Owned by vm/frame.c. */
+    size_t rss;                         /* Resident pages. */
+    size_t rss_limit;                   /* Most resident pages, 0 if any. */
+
+    /* Owned by vm/mmap.c. */
+    struct list mappings;               /* Memory-mapped files. */
+    int next_mapid;                     /* Identifier for next mapping. */
+#endif
 
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
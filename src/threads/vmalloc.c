@@ -0,0 +1,157 @@
+#include "threads/vmalloc.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include "threads/init.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Kernel virtual memory allocator.
+
+   vmalloc() hands out buffers that are contiguous in kernel
+   virtual memory but made of individually allocated physical
+   pages, so that large buffers can be had even when physical
+   memory is too fragmented for palloc_get_multiple().
+
+   The buffers live in a fixed range of kernel virtual addresses
+   starting at VMALLOC_START.  The page tables for the whole
+   range are created by vmalloc_init() in init_page_dir before
+   any process exists, and every page directory created later
+   copies init_page_dir's kernel half, so all page directories
+   share them and a mapping made here is visible everywhere.
+
+   Each buffer is followed by an unmapped guard page.  It
+   catches overruns, and it also marks the end of the buffer, so
+   vfree() does not need to be told the size. */
+
+/* Protects VA_MAP. */
+static struct lock vmalloc_lock;
+
+/* Pages of the vmalloc() range in use, including guard pages. */
+static struct bitmap *va_map;
+
+static uint32_t *lookup_pte (const void *vaddr);
+static void unmap_pages (uint8_t *start, size_t page_cnt);
+
+/* Creates the page tables for the vmalloc() range.  Must be
+   called after paging_init() and before any page directory is
+   created with pagedir_create(). */
+void
+vmalloc_init (void)
+{
+  uint8_t *vaddr;
+
+  for (vaddr = VMALLOC_START; vaddr < (uint8_t *) VMALLOC_END;
+       vaddr += PTSPAN)
+    {
+      uint32_t *pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+      init_page_dir[pd_no (vaddr)] = pde_create (pt);
+    }
+
+  lock_init (&vmalloc_lock);
+  va_map = bitmap_create (VMALLOC_PAGES);
+  if (va_map == NULL)
+    PANIC ("vmalloc_init: bitmap creation failed");
+}
+
+/* Obtains and returns a buffer of at least SIZE bytes that is
+   contiguous in kernel virtual memory, but not necessarily in
+   physical memory.  The buffer is page-aligned and its contents
+   are undefined.  Returns a null pointer if SIZE is zero or if
+   there is not enough virtual or physical memory. */
+void *
+vmalloc (size_t size)
+{
+  size_t page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  size_t page_idx;
+  uint8_t *start;
+  size_t i;
+
+  if (page_cnt == 0 || va_map == NULL)
+    return NULL;
+
+  /* Reserve virtual pages, plus one for the guard page. */
+  lock_acquire (&vmalloc_lock);
+  page_idx = bitmap_scan_and_flip (va_map, 0, page_cnt + 1, false);
+  lock_release (&vmalloc_lock);
+  if (page_idx == BITMAP_ERROR)
+    return NULL;
+  start = (uint8_t *) VMALLOC_START + page_idx * PGSIZE;
+
+  /* Back them with physical pages.  malloc(), which makes most
+     of our allocations, reports the buffer to the profiler as a
+     block, so the pages are not reported separately. */
+  for (i = 0; i < page_cnt; i++)
+    {
+      void *kpage = palloc_get_page (PAL_NOPROF);
+      if (kpage == NULL)
+        {
+          unmap_pages (start, i);
+          lock_acquire (&vmalloc_lock);
+          bitmap_set_multiple (va_map, page_idx, page_cnt + 1, false);
+          lock_release (&vmalloc_lock);
+          return NULL;
+        }
+      *lookup_pte (start + i * PGSIZE) = pte_create_kernel (kpage, true);
+    }
+
+  return start;
+}
+
+/* Frees buffer P, which must have been returned by vmalloc().
+   If P is a null pointer, does nothing. */
+void
+vfree (void *p)
+{
+  uint8_t *start = p;
+  size_t page_cnt;
+
+  if (p == NULL)
+    return;
+
+  ASSERT (is_vmalloc_vaddr (p));
+  ASSERT (pg_ofs (p) == 0);
+
+  /* The buffer ends at its unmapped guard page. */
+  for (page_cnt = 0; *lookup_pte (start + page_cnt * PGSIZE) & PTE_P;
+       page_cnt++)
+    continue;
+  ASSERT (page_cnt > 0);
+  unmap_pages (start, page_cnt);
+
+  lock_acquire (&vmalloc_lock);
+  bitmap_set_multiple (va_map, pg_no (start) - pg_no (VMALLOC_START),
+                       page_cnt + 1, false);
+  lock_release (&vmalloc_lock);
+}
+
+/* Returns the page table entry for VADDR, which must be in the
+   vmalloc() range. */
+static uint32_t *
+lookup_pte (const void *vaddr)
+{
+  ASSERT (is_vmalloc_vaddr (vaddr));
+  return pde_get_pt (init_page_dir[pd_no (vaddr)]) + pt_no (vaddr);
+}
+
+/* Unmaps the PAGE_CNT pages starting at START and frees the
+   physical pages behind them. */
+static void
+unmap_pages (uint8_t *start, size_t page_cnt)
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      uint8_t *vaddr = start + i * PGSIZE;
+      uint32_t *pte = lookup_pte (vaddr);
+      void *kpage = pte_get_page (*pte);
+
+      *pte = 0;
+      asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+      palloc_free_page (kpage);
+    }
+}
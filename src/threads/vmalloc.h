@@ -0,0 +1,27 @@
+#ifndef THREADS_VMALLOC_H
+#define THREADS_VMALLOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/vaddr.h"
+
+/* Kernel virtual range reserved for vmalloc(), well above the
+   mapping of physical memory at PHYS_BASE. */
+#define VMALLOC_START ((void *) 0xe0000000)
+#define VMALLOC_PAGES 4096      /* 16 MB. */
+#define VMALLOC_END ((void *) ((uintptr_t) VMALLOC_START \
+                               + VMALLOC_PAGES * PGSIZE))
+
+void vmalloc_init (void);
+void *vmalloc (size_t);
+void vfree (void *);
+
+/* Returns true if VADDR lies in the vmalloc() range. */
+static inline bool
+is_vmalloc_vaddr (const void *vaddr)
+{
+  return vaddr >= VMALLOC_START && vaddr < VMALLOC_END;
+}
+
+#endif /* threads/vmalloc.h */
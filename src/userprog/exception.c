@@ -4,6 +4,10 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -148,6 +152,27 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+#ifdef VM
+  /* Bring in a page the process has not touched before, or grow
+     its stack, whether the process or the kernel on its behalf
+     touched it.  In the kernel, f->esp is the kernel's stack
+     pointer, so use the one saved on system call entry. */
+  if (not_present && is_user_vaddr (fault_addr))
+    {
+      void *esp = user ? f->esp : thread_current ()->user_esp;
+      if (page_fault_in (fault_addr, write)
+          || page_grow_stack (fault_addr, esp))
+        return;
+    }
+
+  /* Give the process its own copy of a page it shares
+     copy-on-write with its parent or child, or of the zero
+     frame. */
+  if (!not_present && write && is_user_vaddr (fault_addr)
+      && page_unshare (fault_addr))
+    return;
+#endif
+
   /* A page fault in the kernel merely sets EAX to 0xFFFFFFFF and
      copies its former value into EIP.
      See [Pintos] 3.1.5 "Accessing User Memory". */
@@ -7,6 +7,7 @@
 #include <string.h>
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -14,11 +15,20 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 static thread_func start_process NO_RETURN;
+#ifdef VM
+static thread_func start_fork NO_RETURN;
+static bool fork_files (struct thread *parent);
+#endif
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 static void push_arguments_onto_stack (const int argc, const char *argv[],
                                        void **esp);
@@ -31,35 +41,31 @@ tid_t
 process_execute (const char *task)
 {
   char *task_copy;
+  char file_name[16];
+  size_t skip, len;
   tid_t tid;
 
-  /* Make a copy of TASK.
+  /* Make a copy of TASK, just big enough to hold it.
      Otherwise there's a race between the caller and load(). */
-  task_copy = palloc_get_page (PAL_USER);
+  task_copy = malloc (strlen (task) + 1);
   if (task_copy == NULL)
     return TID_ERROR;
-  strlcpy (task_copy, task, PGSIZE);
+  strlcpy (task_copy, task, strlen (task) + 1);
 
-  char *file_name;
-  char *save_ptr;
-
-  /* Make a copy of TASK and parse it into ELF name.
-     Otherwise there's a race between the caller and load(). */
-  file_name = palloc_get_page (PAL_USER);
-  if (file_name == NULL)
-    {
-      palloc_free_page (task_copy);
-      return TID_ERROR;
-    }
-  strlcpy (file_name, task, PGSIZE);
-  file_name = strtok_r (file_name, " \t", &save_ptr);
+  /* Name the new thread after the ELF executable, the first word
+     of TASK, truncated to fit in a thread name. */
+  skip = strspn (task, " \t");
+  len = strcspn (task + skip, " \t");
+  if (len >= sizeof file_name)
+    len = sizeof file_name - 1;
+  memcpy (file_name, task + skip, len);
+  file_name[len] = '\0';
 
   /* Create a new thread to execute FILE_NAME. */
   tid = thread_create (file_name, PRI_DEFAULT, start_process, task_copy);
 
   /* Release memory. */
-  palloc_free_page (task_copy);
-  palloc_free_page (file_name);
+  free (task_copy);
 
   return tid == TID_ERROR ? TID_ERROR : tid;
 }
@@ -72,30 +78,31 @@ start_process (void *task)
   const char delim[] = " \t";
   char *save_ptr;
   int argc = 0;
-  char *argv[strlen (task) / 2 + 1];
+  char **argv;
   char *file_name;
   struct intr_frame if_;
   struct thread *cur;
-  struct lock filesys_lock;
   bool success;
 
-  /* Initialize a file system lock. */
-  lock_init (&filesys_lock);
-
   /* Parse FILE_NAME_, which is the first non-option argument, into
-     a name of ELF file to be executed and its arguments. */
-  file_name = strtok_r (task, delim, &save_ptr);
-  for (argv[argc] = file_name; argv[argc] != NULL;)
-    argv[++argc] = strtok_r (NULL, delim, &save_ptr);
-
-  /* Initialize interrupt frame and load executable. */
-  memset (&if_, 0, sizeof if_);
-  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
-  if_.cs = SEL_UCSEG;
-  if_.eflags = FLAG_IF | FLAG_MBS;
-  lock_acquire (&filesys_lock);
-  success = load (file_name, &if_.eip, &if_.esp);
-  lock_release (&filesys_lock);
+     a name of ELF file to be executed and its arguments.  The
+     argument vector is too big for the kernel stack, so it goes
+     on the heap. */
+  argv = malloc ((strlen (task) / 2 + 2) * sizeof *argv);
+  success = argv != NULL;
+  if (success)
+    {
+      file_name = strtok_r (task, delim, &save_ptr);
+      for (argv[argc] = file_name; argv[argc] != NULL;)
+        argv[++argc] = strtok_r (NULL, delim, &save_ptr);
+
+      /* Initialize interrupt frame and load executable. */
+      memset (&if_, 0, sizeof if_);
+      if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+      if_.cs = SEL_UCSEG;
+      if_.eflags = FLAG_IF | FLAG_MBS;
+      success = load (file_name, &if_.eip, &if_.esp);
+    }
 
   /* Store load result to process control block. */
   cur = thread_current ();
@@ -104,6 +111,7 @@ start_process (void *task)
   /* Push arguments onto the stack. */
   if (success)
     push_arguments_onto_stack (argc, (const char **) argv, &if_.esp);
+  free (argv);
 
   /* Signal that current thread has started its execution. */
   sema_up (&cur->pcb->start);
@@ -122,6 +130,116 @@ start_process (void *task)
   NOT_REACHED ();
 }
 
+#ifdef VM
+/* Passed from process_fork() to start_fork(). */
+struct fork_args
+  {
+    struct thread *parent;      /* Forking process. */
+    struct intr_frame *if_;     /* Its user context at the fork. */
+  };
+
+/* Starts a new process that is a copy of the running one, which
+   entered the kernel through the system call whose frame is
+   IF_.  The child shares the parent's pages copy-on-write and
+   returns to user mode from the same system call, with a result
+   of 0.  Returns the child's thread id, or TID_ERROR if it cannot
+   be created. */
+tid_t
+process_fork (struct intr_frame *if_)
+{
+  struct thread *cur = thread_current ();
+  struct fork_args args;
+
+  args.parent = cur;
+  args.if_ = if_;
+
+  /* thread_create() does not return until the child has copied
+     what it needs from ARGS and from us. */
+  return thread_create (cur->name, PRI_DEFAULT, start_fork, &args);
+}
+
+/* A thread function that copies the address space and open
+   files of the process that forked it and starts running it. */
+static void
+start_fork (void *args_)
+{
+  struct fork_args *args = args_;
+  struct thread *parent = args->parent;
+  struct thread *cur = thread_current ();
+  struct intr_frame if_ = *args->if_;
+  bool success;
+
+  /* Copy the address space. */
+  success = page_table_create ();
+  if (success)
+    {
+      cur->pagedir = pagedir_create ();
+      success = cur->pagedir != NULL;
+    }
+  if (success)
+    {
+      process_activate ();
+
+      cur->elf_executable = file_reopen (parent->elf_executable);
+      if (cur->elf_executable != NULL)
+        file_deny_write (cur->elf_executable);
+
+      success = (cur->elf_executable != NULL
+                 && page_table_copy (parent)
+                 && fork_files (parent));
+    }
+
+  /* Signal that current thread has started its execution. */
+  cur->pcb->start_success = success;
+  sema_up (&cur->pcb->start);
+
+  /* If copying failed, quit. */
+  if (!success)
+    thread_exit ();
+
+  /* Return from the system call in the child. */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Gives the running process its own handle on each file PARENT
+   has open, with the same descriptor and position.  Returns
+   true if successful, false if memory ran out. */
+static bool
+fork_files (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+  bool success = true;
+  int fd;
+
+  if (parent->file_cnt == 0)
+    return true;
+  cur->files = calloc (parent->file_cnt, sizeof *cur->files);
+  if (cur->files == NULL)
+    return false;
+  cur->file_cnt = parent->file_cnt;
+  cur->free_fd = parent->free_fd;
+
+  for (fd = 0; fd < parent->file_cnt; fd++)
+    {
+      struct file *file = parent->files[fd];
+
+      if (file == NULL)
+        continue;
+      cur->files[fd] = file_reopen (file);
+      if (cur->files[fd] == NULL)
+        {
+          success = false;
+          break;
+        }
+      file_seek (cur->files[fd], file_tell (file));
+    }
+
+  return success;
+}
+#endif
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -169,7 +287,7 @@ process_wait (tid_t child_tid UNUSED)
   /* Clean up child and return its exit status. */
   exit_status = child->exit_status;
   list_remove (element);
-  palloc_free_page (child);
+  free (child);
 
   return exit_status;
 }
@@ -180,11 +298,15 @@ process_exit (void)
 {
   struct thread *cur = thread_current ();
   int exit_status = cur->pcb->exit_status;
-  struct lock filesys_lock;
   uint32_t *pd;
 
-  /* Initialize a file system lock. */
-  lock_init (&filesys_lock);
+#ifdef VM
+  /* Write back and unmap memory-mapped files, and free the
+     process's frames, before a waiting parent can look at the
+     files or write the executable. */
+  mmap_unmap_all ();
+  page_table_destroy ();
+#endif
 
   /* For each child, if child is alive set its ORPHAN to true.
      If child is not alive, release its process control block. */
@@ -196,7 +318,7 @@ process_exit (void)
       if (child->alive)
         child->orphan = true;
       else
-        palloc_free_page (child);
+        free (child);
     }
 
   /* Set current thread's ALIVE to false. */
@@ -209,22 +331,16 @@ process_exit (void)
   if (cur->elf_executable != NULL)
     {
       file_allow_write (cur->elf_executable);
-
-      lock_acquire (&filesys_lock);
       file_close (cur->elf_executable);
-      lock_release (&filesys_lock);
     }
 
   /* Close all opened files. */
-  while (!list_empty (&cur->files))
-    {
-      struct list_elem *element = list_pop_front (&cur->files);
-      struct file *file = list_entry (element, struct file, elem);
-
-      lock_acquire (&filesys_lock);
-      file_close (file);
-      lock_release (&filesys_lock);
-    }
+  for (int fd = 0; fd < cur->file_cnt; fd++)
+    if (cur->files[fd] != NULL)
+      file_close (cur->files[fd]);
+  free (cur->files);
+  cur->files = NULL;
+  cur->file_cnt = 0;
 
   /* Print exit status. */
   printf ("%s: exit(%d)\n", cur->name, exit_status);
@@ -232,7 +348,7 @@ process_exit (void)
   /* If current thread is orphan, release its process control block.
      Otherwise, it will be released when its parent calls wait() or exits. */
   if (cur->pcb->orphan)
-    palloc_free_page (cur->pcb);
+    free (cur->pcb);
 
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
@@ -351,6 +467,12 @@ load (const char *file_name, void (**eip) (void), void **esp)
   bool success = false;
   int i;
 
+#ifdef VM
+  /* Allocate supplemental page table. */
+  if (!page_table_create ())
+    goto done;
+#endif
+
   /* Allocate and activate page directory. */
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL)
@@ -462,7 +584,9 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -521,6 +645,10 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With virtual memory, the pages are only recorded in the
+   supplemental page table here, and are read in or zeroed when
+   the process first touches them.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -531,7 +659,9 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifndef VM
   file_seek (file, ofs);
+#endif
   while (read_bytes > 0 || zero_bytes > 0)
     {
       /* Calculate how to fill this page.
@@ -540,8 +670,19 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-      /* Get a page of memory. */
-      uint8_t *kpage = palloc_get_page (PAL_USER);
+#ifdef VM
+      /* Record where the page comes from.  It is read in when the
+         process first touches it. */
+      if (page_read_bytes > 0
+          ? !page_add_file (upage, file, ofs, page_read_bytes, writable)
+          : !page_add_zero (upage, writable))
+        return false;
+      ofs += page_read_bytes;
+#else
+      /* Get a page of memory.  Pages that are entirely zero come
+         from palloc already cleared. */
+      uint8_t *kpage = palloc_get_page (page_read_bytes == 0
+                                        ? PAL_USER | PAL_ZERO : PAL_USER);
       if (kpage == NULL)
         return false;
 
@@ -551,7 +692,8 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false;
         }
-      memset (kpage + page_read_bytes, 0, page_zero_bytes);
+      if (page_read_bytes != 0)
+        memset (kpage + page_read_bytes, 0, page_zero_bytes);
 
       /* Add the page to the process's address space. */
       if (!install_page (upage, kpage, writable))
@@ -559,6 +701,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false;
         }
+#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
@@ -573,6 +716,16 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp)
 {
+#ifdef VM
+  /* The stack page is an ordinary zero-fill page, so that it can
+     be evicted like any other.  Bring it in now, since the
+     arguments are about to be pushed onto it. */
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+  if (!page_add_zero (upage, true) || !page_fault_in (upage, true))
+    return false;
+  *esp = PHYS_BASE;
+  return true;
+#else
   uint8_t *kpage;
   bool success = false;
 
@@ -586,8 +739,10 @@ setup_stack (void **esp)
         palloc_free_page (kpage);
     }
   return success;
+#endif
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -607,6 +762,7 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
 
 /* Push arguments onto the stack obeying 80x86 calling convention. */
 static void
@@ -617,28 +773,31 @@ push_arguments_onto_stack (const int argc, const char *argv[], void **esp)
   ASSERT (esp != NULL);
 
   const uintptr_t WORD = 4;
-  uintptr_t argv_addr[argc + 1];
+  uintptr_t arg_addr;
 
   /* Push arguments. */
-  argv_addr[argc] = (uintptr_t) PHYS_BASE;
   for (int i = argc - 1; i >= 0; --i)
     {
       size_t argv_size = strlen (argv[i]) + 1;
-      argv_addr[i] = argv_addr[i + 1] - argv_size;
 
       *esp -= argv_size;
       memcpy (*esp, argv[i], argv_size);
     }
-  argv_addr[argc] = 0;
 
   /* Push word alignment. */
   *esp -= (uintptr_t) *esp % WORD;
 
-  /* Push pointers to arguments. */
-  for (int i = argc; i >= 0; --i)
+  /* Push a null pointer sentinel, then pointers to arguments.
+     The arguments were pushed in the same order, so each one's
+     address follows from the lengths of those above it. */
+  *esp -= WORD;
+  memset (*esp, 0, WORD);
+  arg_addr = (uintptr_t) PHYS_BASE;
+  for (int i = argc - 1; i >= 0; --i)
     {
+      arg_addr -= strlen (argv[i]) + 1;
       *esp -= WORD;
-      memcpy (*esp, &argv_addr[i], WORD);
+      memcpy (*esp, &arg_addr, WORD);
     }
 
   /* Push a pointer to the argument vector. */
@@ -25,7 +25,12 @@ struct process
     struct list_elem elem;  /* List element. */
   };
 
+struct intr_frame;
+
 tid_t process_execute (const char *task);
+#ifdef VM
+tid_t process_fork (struct intr_frame *);
+#endif
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
@@ -1,23 +1,44 @@
 #include "userprog/syscall.h"
+#include <limits.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include <uio.h>
 #include "devices/input.h"
 #include "devices/shutdown.h"
+#include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "userprog/process.h"
-
-static int get_user (const uint8_t *uaddr);
-static void indirect_user (const void *uptr, void *uindirect);
-static bool put_user (uint8_t *udst, uint8_t byte);
-static void *validate_ptr (void *ptr);
-static int allocate_fd (void);
-static struct file *find_file_by_fd (struct list *files, const int fd);
-static void remove_file_by_fd (struct list *files, const int fd);
+#ifdef VM
+#include "vm/mmap.h"
+#endif
+
+static size_t copy_user (void *dst, const void *src, size_t size);
+static bool is_user_range (const void *uaddr, size_t size);
+static bool copy_from_user (void *kdst, const void *usrc, size_t size);
+static bool copy_to_user (void *udst, const void *ksrc, size_t size);
+static int strncpy_from_user (char *kdst, const char *usrc, size_t size);
+static void get_args (const struct intr_frame *f, uint32_t *args, size_t cnt);
+static bool get_file_name (char name[NAME_MAX + 2], const char *ufile);
+static int get_iovec (struct iovec iov[IOV_MAX], const struct iovec *uiov,
+                      int iovcnt);
+static bool get_buffer (struct iovec *iov, const void *buffer, unsigned size);
+static int read_iov (struct file *file, const struct iovec *iov, int total,
+                     off_t ofs);
+static int write_iov (struct file *file, const struct iovec *iov,
+                      int iovcnt, off_t ofs);
+static bool write_run (struct file *file, const void *kbuf, size_t size,
+                       off_t ofs, int *done);
+static int allocate_fd (struct file *file);
+static struct file *find_file_by_fd (int fd);
+static void remove_file_by_fd (int fd);
 
 static void syscall_handler (struct intr_frame *);
 static void halt (void);
@@ -30,82 +51,145 @@ static int open (const char *filename);
 static int filesize (int fd);
 static int read (int fd, void *buffer, unsigned int size);
 static int write (int fd, const void *buffer, unsigned int size);
+static int readv (int fd, const struct iovec *iov, int iovcnt);
+static int writev (int fd, const struct iovec *iov, int iovcnt);
+static int pread (int fd, void *buffer, unsigned size, unsigned offset);
+static int pwrite (int fd, const void *buffer, unsigned size,
+                   unsigned offset);
 static void seek (int fd, unsigned position);
 static unsigned tell (int fd);
 static void close (int fd);
+#ifdef VM
+static mapid_t mmap (int fd, void *addr);
+static void munmap (mapid_t mapid);
+static void rsslimit (unsigned pages);
+static unsigned getrss (void);
+static unsigned getwss (void);
+#endif
 static int fibonacci (int n);
 static int max_of_four_int (int a, int b, int c, int d);
 
-static struct lock filesys_lock;
-
 void
 syscall_init (void)
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
-  lock_init (&filesys_lock);
 }
 
 static void
 syscall_handler (struct intr_frame *f UNUSED)
 {
+  uint32_t args[4];
+  int syscall_num;
+
   ASSERT (f != NULL);
 
-  int syscall_num = *(int *) validate_ptr (f->esp);
+#ifdef VM
+  /* Save the user stack pointer, since a fault in the kernel on
+     a user stack page that has not been grown yet will need it. */
+  thread_current ()->user_esp = f->esp;
+#endif
+
+  if (!copy_from_user (&syscall_num, f->esp, sizeof syscall_num))
+    exit (-1);
   switch (syscall_num)
     {
       case SYS_HALT:
         halt ();
         break;
       case SYS_EXIT:
-        exit (*(int *) validate_ptr (f->esp + 4));
+        get_args (f, args, 1);
+        exit (args[0]);
         break;
       case SYS_EXEC:
-        f->eax = exec (validate_ptr (f->esp + 4));
+        get_args (f, args, 1);
+        f->eax = exec ((const char *) args[0]);
         break;
       case SYS_WAIT:
-        f->eax = wait (*(tid_t *) validate_ptr (f->esp + 4));
+        get_args (f, args, 1);
+        f->eax = wait (args[0]);
         break;
       case SYS_CREATE:
-        f->eax = create (validate_ptr (f->esp + 4),
-                         *(unsigned int *) validate_ptr (f->esp + 8));
+        get_args (f, args, 2);
+        f->eax = create ((const char *) args[0], args[1]);
         break;
       case SYS_REMOVE:
-        f->eax = remove (validate_ptr (f->esp + 4));
+        get_args (f, args, 1);
+        f->eax = remove ((const char *) args[0]);
         break;
       case SYS_OPEN:
-        f->eax = open (validate_ptr (f->esp + 4));
+        get_args (f, args, 1);
+        f->eax = open ((const char *) args[0]);
         break;
       case SYS_FILESIZE:
-        f->eax = filesize (*(int *) validate_ptr (f->esp + 4));
+        get_args (f, args, 1);
+        f->eax = filesize (args[0]);
         break;
       case SYS_READ:
-        f->eax = read (*(int *) validate_ptr (f->esp + 4),
-                       validate_ptr (f->esp + 8),
-                       *(unsigned int *) validate_ptr (f->esp + 12));
+        get_args (f, args, 3);
+        f->eax = read (args[0], (void *) args[1], args[2]);
         break;
       case SYS_WRITE:
-        f->eax = write (*(int *) validate_ptr (f->esp + 4),
-                        validate_ptr (f->esp + 8),
-                        *(unsigned int *) validate_ptr (f->esp + 12));
+        get_args (f, args, 3);
+        f->eax = write (args[0], (const void *) args[1], args[2]);
+        break;
+      case SYS_READV:
+        get_args (f, args, 3);
+        f->eax = readv (args[0], (const struct iovec *) args[1], args[2]);
+        break;
+      case SYS_WRITEV:
+        get_args (f, args, 3);
+        f->eax = writev (args[0], (const struct iovec *) args[1], args[2]);
+        break;
+      case SYS_PREAD:
+        get_args (f, args, 4);
+        f->eax = pread (args[0], (void *) args[1], args[2], args[3]);
+        break;
+      case SYS_PWRITE:
+        get_args (f, args, 4);
+        f->eax = pwrite (args[0], (const void *) args[1], args[2], args[3]);
         break;
       case SYS_SEEK:
-        seek (*(int *) validate_ptr (f->esp + 4),
-              *(unsigned int *) validate_ptr (f->esp + 8));
+        get_args (f, args, 2);
+        seek (args[0], args[1]);
         break;
       case SYS_TELL:
-        f->eax = tell (*(int *) validate_ptr (f->esp + 4));
+        get_args (f, args, 1);
+        f->eax = tell (args[0]);
         break;
       case SYS_CLOSE:
-        close (*(int *) validate_ptr (f->esp + 4));
+        get_args (f, args, 1);
+        close (args[0]);
         break;
       case SYS_FIBONACCI:
-        f->eax = fibonacci (*(int *) validate_ptr (f->esp + 4));
+        get_args (f, args, 1);
+        f->eax = fibonacci (args[0]);
+        break;
+#ifdef VM
+      case SYS_FORK:
+        f->eax = process_fork (f);
+        break;
+      case SYS_MMAP:
+        get_args (f, args, 2);
+        f->eax = mmap (args[0], (void *) args[1]);
         break;
+      case SYS_MUNMAP:
+        get_args (f, args, 1);
+        munmap (args[0]);
+        break;
+      case SYS_RSSLIMIT:
+        get_args (f, args, 1);
+        rsslimit (args[0]);
+        break;
+      case SYS_GETRSS:
+        f->eax = getrss ();
+        break;
+      case SYS_GETWSS:
+        f->eax = getwss ();
+        break;
+#endif
       case SYS_MAXOFFOURINT:
-        f->eax = max_of_four_int (*(int *) validate_ptr (f->esp + 4),
-                                  *(int *) validate_ptr (f->esp + 8),
-                                  *(int *) validate_ptr (f->esp + 12),
-                                  *(int *) validate_ptr (f->esp + 16));
+        get_args (f, args, 4);
+        f->eax = max_of_four_int (args[0], args[1], args[2], args[3]);
         break;
       default:
         /* Invalid system call number. Terminate current process. */
@@ -114,119 +198,357 @@ syscall_handler (struct intr_frame *f UNUSED)
     }
 }
 
-/* Reads a byte at user virtual address UADDR.
-   UADDR must be below PHYS_BASE.
-   Returns the byte value if successful, -1 if a segfault occurred. */
-static int
-get_user (const uint8_t *uaddr)
+/* Copies SIZE bytes from SRC to DST, one of which is a user
+   address already checked to lie below PHYS_BASE, a word at a
+   time and then a byte at a time.  Returns the number of bytes
+   left uncopied, which is 0 unless a segfault occurred.
+
+   This relies on the page fault handler, when it cannot resolve
+   a fault in the kernel, to resume at the label in EAX with EAX
+   set to -1.  A fault partway through "rep movs" leaves ECX
+   counting what was not copied. */
+static size_t
+copy_user (void *dst, const void *src, size_t size)
+{
+  size_t words = size / 4;
+  size_t bytes = size % 4;
+
+  asm volatile ("movl $1f, %%eax; rep movsl; 1:"
+                : "+D" (dst), "+S" (src), "+c" (words) : : "eax", "memory");
+  if (words != 0)
+    return words * 4 + bytes;
+  asm volatile ("movl $1f, %%eax; rep movsb; 1:"
+                : "+D" (dst), "+S" (src), "+c" (bytes) : : "eax", "memory");
+  return bytes;
+}
+
+/* Returns true if the SIZE bytes starting at UADDR all lie below
+   PHYS_BASE, false otherwise. */
+static bool
+is_user_range (const void *uaddr, size_t size)
+{
+  return (is_user_vaddr (uaddr)
+          && size <= (size_t) (PHYS_BASE - uaddr));
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address
+   KDST.  Returns true if successful, false if any of the source
+   is not mapped user memory. */
+static bool
+copy_from_user (void *kdst, const void *usrc, size_t size)
 {
-  ASSERT (uaddr != NULL);
+  return is_user_range (usrc, size) && copy_user (kdst, usrc, size) == 0;
+}
 
-  int result;
-  asm ("movl $1f, %0; movzbl %1, %0; 1:"
-      : "=&a" (result) : "m" (*uaddr));
+/* Copies SIZE bytes from kernel address KSRC to user address
+   UDST.  Returns true if successful, false if any of the
+   destination is not writable user memory. */
+static bool
+copy_to_user (void *udst, const void *ksrc, size_t size)
+{
+  return is_user_range (udst, size) && copy_user (udst, ksrc, size) == 0;
+}
 
-  return result;
+/* Copies the null-terminated string at user address USRC into
+   the SIZE bytes at KDST, a page's worth at a time, never
+   reading past the page that holds the null terminator.
+   Returns the string's length, SIZE if it has no null
+   terminator within SIZE bytes (leaving KDST unterminated), or
+   -1 if it runs into memory that is not mapped user memory. */
+static int
+strncpy_from_user (char *kdst, const char *usrc, size_t size)
+{
+  size_t copied = 0;
+
+  while (copied < size)
+    {
+      const char *usrc_ofs = usrc + copied;
+      size_t chunk = PGSIZE - pg_ofs (usrc_ofs);
+      const char *nul;
+
+      if (chunk > size - copied)
+        chunk = size - copied;
+      if (!copy_from_user (kdst + copied, usrc_ofs, chunk))
+        return -1;
+
+      nul = memchr (kdst + copied, '\0', chunk);
+      if (nul != NULL)
+        return nul - kdst;
+      copied += chunk;
+    }
+  return size;
 }
 
-/* Replace UINDIRECT with the indirected user virtual address UPTR.
-   In order to do that, UINDIRECT must be a pointer to a void * typed variable,
-   which is used to indirect address accessing.
-   If UPTR is invalid, call EXIT (-1) and terminate current process. */
+/* Copies the CNT 32-bit arguments of the system call in F into
+   ARGS, or terminates the process if they are not all in mapped
+   user memory. */
 static void
-indirect_user (const void *uptr, void *uindirect)
+get_args (const struct intr_frame *f, uint32_t *args, size_t cnt)
+{
+  if (!copy_from_user (args, (uint32_t *) f->esp + 1, cnt * sizeof *args))
+    exit (-1);
+}
+
+/* Copies the file name at user address UFILE into NAME.  Returns
+   true if successful, false if the name is longer than NAME_MAX
+   and so cannot name any file.  Terminates the process if UFILE
+   is not a valid user string. */
+static bool
+get_file_name (char name[NAME_MAX + 2], const char *ufile)
+{
+  int len = strncpy_from_user (name, ufile, NAME_MAX + 2);
+
+  if (len < 0)
+    exit (-1);
+  return len <= NAME_MAX;
+}
+
+/* Copies the IOVCNT buffer descriptors at user address UIOV into
+   IOV and returns the buffers' total length.  Returns -1 if
+   IOVCNT is negative or more than IOV_MAX, or if the total does
+   not fit in an int.  Terminates the process if UIOV, or any of
+   the buffers, is not in user memory. */
+static int
+get_iovec (struct iovec iov[IOV_MAX], const struct iovec *uiov, int iovcnt)
 {
-  ASSERT (uptr != NULL);
-  ASSERT (uindirect != NULL);
+  size_t total = 0;
+  int i;
 
-  for (size_t i = 0; i < sizeof uptr; ++i)
+  if (iovcnt < 0 || iovcnt > IOV_MAX)
+    return -1;
+  if (!copy_from_user (iov, uiov, iovcnt * sizeof *iov))
+    exit (-1);
+
+  for (i = 0; i < iovcnt; i++)
     {
-      int value = get_user (uptr + i);
-      if (value == -1)
+      if (!is_user_range (iov[i].iov_base, iov[i].iov_len))
         exit (-1);
-
-      *(char *) (uindirect + i) = value & 0xFF;
+      if (iov[i].iov_len > INT_MAX - total)
+        return -1;
+      total += iov[i].iov_len;
     }
+
+  return total;
 }
 
-/* Writes BYTE to user address UDST.
-   UDST must be below PHYS_BASE.
-   Returns true if successful, false if a segfault occurred. */
+/* Describes the SIZE bytes at user address BUFFER in *IOV, for
+   read_iov() or write_iov().  Returns false if SIZE does not fit
+   in an int.  Terminates the process if the buffer is not in
+   user memory. */
 static bool
-put_user (uint8_t *udst, uint8_t byte)
+get_buffer (struct iovec *iov, const void *buffer, unsigned size)
 {
-  ASSERT (udst != NULL);
+  if (!is_user_range (buffer, size))
+    exit (-1);
+  iov->iov_base = (void *) buffer;
+  iov->iov_len = size;
+  return size <= INT_MAX;
+}
+
+/* Reads TOTAL bytes from FILE, or from the keyboard if FILE is
+   null, into the user buffers in IOV, whose lengths add up to at
+   least TOTAL, and returns the number of bytes read, or -1 if
+   memory ran out.  Reads at byte OFS of FILE if OFS is not
+   negative, at FILE's position otherwise.
+
+   The data is read a page at a time into a kernel page and then
+   scattered across the buffers.  Thus the file system never
+   touches user memory, and a long list of small buffers costs
+   one file system call per page rather than one system call per
+   buffer.  Terminates the process if a buffer turns out not to
+   be writable user memory. */
+static int
+read_iov (struct file *file, const struct iovec *iov, int total, off_t ofs)
+{
+  uint8_t *bounce;
+  int done = 0;
+  int i = 0;
+  size_t iov_ofs = 0;
+
+  bounce = palloc_get_page (0);
+  if (bounce == NULL)
+    return -1;
 
-  int error_code;
-  asm ("movl $1f, %0; movb %b2, %1; 1:"
-      : "=&a" (error_code), "=m" (*udst) : "q" (byte));
+  while (done < total)
+    {
+      int run = total - done < PGSIZE ? total - done : PGSIZE;
+      int n, j;
+
+      /* Read a page, or what is left... */
+      if (file == NULL)
+        for (n = 0; n < run; n++)
+          bounce[n] = input_getc ();
+      else if (ofs < 0)
+        n = file_read (file, bounce, run);
+      else
+        n = file_read_at (file, bounce, run, ofs + done);
+
+      /* ...and scatter it, continuing at byte IOV_OFS of IOV[I]. */
+      for (j = 0; j < n; )
+        {
+          size_t chunk = iov[i].iov_len - iov_ofs;
+
+          if (chunk > (size_t) (n - j))
+            chunk = n - j;
+          if (!copy_to_user ((uint8_t *) iov[i].iov_base + iov_ofs,
+                             bounce + j, chunk))
+            {
+              palloc_free_page (bounce);
+              exit (-1);
+            }
+          j += chunk;
+          iov_ofs += chunk;
+          if (iov_ofs == iov[i].iov_len)
+            {
+              i++;
+              iov_ofs = 0;
+            }
+        }
 
-  return error_code != -1;
+      done += n;
+      if (n < run)
+        break;
+    }
+
+  palloc_free_page (bounce);
+  return done;
 }
 
-/* Return PTR if it is not NULL and points to a valid user virtual address.
-   Otherwise, call EXIT (-1) and terminate current process. */
-static void *
-validate_ptr (void *ptr)
+/* Writes the IOVCNT user buffers in IOV to FILE, or to the
+   console if FILE is null, and returns the number of bytes
+   written, or -1 if memory ran out.  Writes at byte OFS of FILE
+   if OFS is not negative, at FILE's position otherwise.
+
+   The buffers are gathered into a kernel page, and each full
+   page, and whatever is left at the end, goes to the file in one
+   file system call.  Terminates the process if a buffer turns
+   out not to be mapped user memory. */
+static int
+write_iov (struct file *file, const struct iovec *iov, int iovcnt,
+           off_t ofs)
 {
-  if (ptr == NULL)
-    exit (-1);
+  uint8_t *bounce;
+  size_t used = 0;
+  int done = 0;
+  int i;
 
-  if (!is_user_vaddr (ptr))
-    exit (-1);
+  bounce = palloc_get_page (0);
+  if (bounce == NULL)
+    return -1;
 
-  for (size_t i = 0; i < sizeof ptr; ++i)
-    if (get_user (ptr + i) == -1)
-      exit (-1);
+  for (i = 0; i < iovcnt; i++)
+    {
+      const uint8_t *base = iov[i].iov_base;
+      size_t left = iov[i].iov_len;
+
+      while (left > 0)
+        {
+          size_t chunk = PGSIZE - used < left ? PGSIZE - used : left;
+
+          if (!copy_from_user (bounce + used, base, chunk))
+            {
+              palloc_free_page (bounce);
+              exit (-1);
+            }
+          base += chunk;
+          left -= chunk;
+          used += chunk;
+
+          if (used == PGSIZE)
+            {
+              if (!write_run (file, bounce, used, ofs, &done))
+                goto done;
+              used = 0;
+            }
+        }
+    }
+  if (used > 0)
+    write_run (file, bounce, used, ofs, &done);
+
+ done:
+  palloc_free_page (bounce);
+  return done;
+}
+
+/* Writes the SIZE bytes at KBUF to FILE, or to the console if
+   FILE is null, and adds the number of bytes written to *DONE.
+   Writes at byte OFS + *DONE of FILE if OFS is not negative, at
+   FILE's position otherwise.  Returns true if all of the bytes
+   were written. */
+static bool
+write_run (struct file *file, const void *kbuf, size_t size, off_t ofs,
+           int *done)
+{
+  off_t written = size;
 
-  return ptr;
+  if (file == NULL)
+    putbuf (kbuf, size);
+  else if (ofs < 0)
+    written = file_write (file, kbuf, size);
+  else
+    written = file_write_at (file, kbuf, size, ofs + *done);
+  *done += written;
+
+  return (size_t) written == size;
 }
 
-/* Returns a file descriptor to use for a new file. */
+/* Puts FILE in the lowest free slot of the current process's
+   file table, growing the table if it is full, and returns the
+   slot's index as FILE's descriptor.  Returns -1 if memory ran
+   out.  Descriptors 0 and 1 are STDIN_FILENO and STDOUT_FILENO
+   and never name a file. */
 static int
-allocate_fd (void)
+allocate_fd (struct file *file)
 {
-  static int next_fd = 2; // 0 is STDIN_FILENO and 1 is STDOUT_FILENO.
+  struct thread *cur = thread_current ();
   int fd;
 
-  lock_acquire (&filesys_lock);
-  fd = next_fd++;
-  lock_release (&filesys_lock);
+  for (fd = cur->free_fd; fd < cur->file_cnt; fd++)
+    if (cur->files[fd] == NULL)
+      break;
+
+  if (fd >= cur->file_cnt)
+    {
+      int new_cnt = cur->file_cnt > 0 ? cur->file_cnt * 2 : 16;
+      struct file **files = realloc (cur->files, new_cnt * sizeof *files);
+
+      if (files == NULL)
+        return -1;
+      memset (files + cur->file_cnt, 0,
+              (new_cnt - cur->file_cnt) * sizeof *files);
+      cur->files = files;
+      cur->file_cnt = new_cnt;
+    }
+
+  cur->files[fd] = file;
+  cur->free_fd = fd + 1;
 
   return fd;
 }
 
-/* Returns a file corresponding to FD. */
+/* Returns a file corresponding to FD, or NULL if there is none. */
 static struct file *
-find_file_by_fd (struct list *files, const int fd)
+find_file_by_fd (int fd)
 {
-  struct file *file = NULL;
+  struct thread *cur = thread_current ();
 
-  for (struct list_elem *element = list_begin (files);
-       element != list_end (files); element = list_next (element))
-    {
-      file = list_entry (element, struct file, elem);
-      if (file->fd == fd)
-        break;
-    }
+  if (fd < 2 || fd >= cur->file_cnt)
+    return NULL;
 
-  return file;
+  return cur->files[fd];
 }
 
-/* Remove a file corresponding to FD. */
+/* Remove a file corresponding to FD, making FD free for reuse. */
 static void
-remove_file_by_fd (struct list *files, const int fd)
+remove_file_by_fd (int fd)
 {
-  for (struct list_elem *element = list_begin (files);
-       element != list_end (files); element = list_next (element))
-    {
-      struct file *file = list_entry (element, struct file, elem);
-      if (file->fd == fd)
-        {
-          list_remove (element);
-          return;
-        }
-    }
+  struct thread *cur = thread_current ();
+
+  ASSERT (fd >= 2 && fd < cur->file_cnt);
+
+  cur->files[fd] = NULL;
+  if (fd < cur->free_fd)
+    cur->free_fd = fd;
 }
 
 /* Halt the operating system. */
@@ -240,9 +562,6 @@ halt (void)
 static void
 exit (int status)
 {
-  if (lock_held_by_current_thread (&filesys_lock))
-    lock_release (&filesys_lock);
-
   thread_current ()->pcb->exit_status = status;
   thread_exit ();
 }
@@ -251,13 +570,25 @@ exit (int status)
 static tid_t
 exec (const char *task)
 {
-  ASSERT (task != NULL);
+  char *task_copy;
+  int len;
+  tid_t tid;
+
+  task_copy = palloc_get_page (0);
+  if (task_copy == NULL)
+    return TID_ERROR;
+
+  len = strncpy_from_user (task_copy, task, PGSIZE);
+  if (len < 0)
+    {
+      palloc_free_page (task_copy);
+      exit (-1);
+    }
 
-  void *buffer_indirect;
-  indirect_user (task, &buffer_indirect);
-  validate_ptr (buffer_indirect);
+  tid = len < PGSIZE ? process_execute (task_copy) : TID_ERROR;
+  palloc_free_page (task_copy);
 
-  return process_execute (buffer_indirect);
+  return tid;
 }
 
 /* Wait for a child process to die. */
@@ -273,15 +604,12 @@ wait (tid_t tid)
 bool
 create (const char *filename, unsigned initial_size)
 {
-  ASSERT (filename != NULL);
+  char name[NAME_MAX + 2];
 
-  void *filename_indirect;
-  indirect_user (filename, &filename_indirect);
-  validate_ptr (filename_indirect);
+  if (!get_file_name (name, filename))
+    return false;
 
-  lock_acquire (&filesys_lock);
-  bool success = filesys_create (filename_indirect, initial_size);
-  lock_release (&filesys_lock);
+  bool success = filesys_create (name, initial_size);
 
   return success;
 }
@@ -290,15 +618,12 @@ create (const char *filename, unsigned initial_size)
 bool
 remove (const char *filename)
 {
-  ASSERT (filename != NULL);
+  char name[NAME_MAX + 2];
 
-  void *filename_indirect;
-  indirect_user (filename, &filename_indirect);
-  validate_ptr (filename_indirect);
+  if (!get_file_name (name, filename))
+    return false;
 
-  lock_acquire (&filesys_lock);
-  bool success = filesys_remove (filename_indirect);
-  lock_release (&filesys_lock);
+  bool success = filesys_remove (name);
 
   return success;
 }
@@ -307,23 +632,21 @@ remove (const char *filename)
 int
 open (const char *filename)
 {
-  ASSERT (filename != NULL);
+  char name[NAME_MAX + 2];
 
-  void *filename_indirect;
-  indirect_user (filename, &filename_indirect);
-  validate_ptr (filename_indirect);
+  if (!get_file_name (name, filename))
+    return -1;
 
-  lock_acquire (&filesys_lock);
-  struct file *file = filesys_open (filename_indirect);
-  lock_release (&filesys_lock);
+  struct file *file = filesys_open (name);
 
   if (file == NULL)
     return -1;
 
-  file->fd = allocate_fd ();
-  list_push_back (&thread_current ()->files, &file->elem);
+  int fd = allocate_fd (file);
+  if (fd == -1)
+    file_close (file);
 
-  return file->fd;
+  return fd;
 }
 
 /* Obtain a file's size. */
@@ -331,16 +654,14 @@ int
 filesize (int fd)
 {
   /* Find a file of FD. */
-  struct file *file = find_file_by_fd (&thread_current ()->files, fd);
+  struct file *file = find_file_by_fd (fd);
 
   /* If such file is not found, don't progress further. */
   if (file == NULL)
     return 0;
 
   /* Get the size of FILE in bytes. */
-  lock_acquire (&filesys_lock);
   int length = (int) file_length (file);
-  lock_release (&filesys_lock);
 
   return length;
 }
@@ -349,70 +670,110 @@ filesize (int fd)
 static int
 read (int fd, void *buffer, unsigned int size)
 {
-  ASSERT (buffer != NULL);
+  struct iovec iov;
+  struct file *file = NULL;
 
-  void *buffer_indirect;
-  indirect_user (buffer, &buffer_indirect);
-  validate_ptr (buffer_indirect);
+  if (!get_buffer (&iov, buffer, size))
+    return -1;
 
-  if (fd == STDIN_FILENO)
-    {
-      lock_acquire (&filesys_lock);
-      for (unsigned int i = 0; i < size; ++i)
-        if (!put_user (buffer_indirect + i, input_getc ()))
-          exit (-1);
-      lock_release (&filesys_lock);
+  /* Find a file of FD, unless it is the keyboard. */
+  if (fd != STDIN_FILENO && (file = find_file_by_fd (fd)) == NULL)
+    return 0;
 
-      return size;
-    }
+  return read_iov (file, &iov, size, -1);
+}
 
-  /* Find a file of FD. */
-  struct file *file = find_file_by_fd (&thread_current ()->files, fd);
+/* Write to a file. */
+static int
+write (int fd, const void *buffer, unsigned int size)
+{
+  struct iovec iov;
+  struct file *file = NULL;
 
-  /* If such file is not found, don't progress further. */
-  if (file == NULL)
+  if (!get_buffer (&iov, buffer, size))
+    return -1;
+
+  /* Find a file of FD, unless it is the console. */
+  if (fd != STDOUT_FILENO && (file = find_file_by_fd (fd)) == NULL)
     return 0;
 
-  /* Read SIZE bytes from FILE to BUFFER. */
-  lock_acquire (&filesys_lock);
-  int bytes_read = (int) file_read (file, buffer_indirect, size);
-  lock_release (&filesys_lock);
+  return write_iov (file, &iov, 1, -1);
+}
+
+/* Read from a file into several buffers. */
+static int
+readv (int fd, const struct iovec *uiov, int iovcnt)
+{
+  struct iovec iov[IOV_MAX];
+  struct file *file = NULL;
+  int total;
+
+  total = get_iovec (iov, uiov, iovcnt);
+  if (total < 0)
+    return -1;
+
+  /* Find a file of FD, unless it is the keyboard. */
+  if (fd != STDIN_FILENO && (file = find_file_by_fd (fd)) == NULL)
+    return 0;
 
-  return bytes_read;
+  return read_iov (file, iov, total, -1);
 }
 
-/* Write to a file. */
+/* Write to a file from several buffers. */
 static int
-write (int fd, const void *buffer, unsigned int size)
+writev (int fd, const struct iovec *uiov, int iovcnt)
 {
-  ASSERT (buffer != NULL);
+  struct iovec iov[IOV_MAX];
+  struct file *file = NULL;
 
-  void *buffer_indirect;
-  indirect_user (buffer, &buffer_indirect);
-  validate_ptr (buffer_indirect);
+  if (get_iovec (iov, uiov, iovcnt) < 0)
+    return -1;
 
-  if (fd == STDOUT_FILENO)
-    {
-      lock_acquire (&filesys_lock);
-      putbuf (buffer_indirect, size);
-      lock_release (&filesys_lock);
+  /* Find a file of FD, unless it is the console. */
+  if (fd != STDOUT_FILENO && (file = find_file_by_fd (fd)) == NULL)
+    return 0;
 
-      return size;
-    }
+  return write_iov (file, iov, iovcnt, -1);
+}
+
+/* Read from a file at OFFSET, leaving its position alone. */
+static int
+pread (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  struct iovec iov;
+
+  if (!get_buffer (&iov, buffer, size))
+    return -1;
 
   /* Find a file of FD. */
-  struct file *file = find_file_by_fd (&thread_current ()->files, fd);
+  struct file *file = find_file_by_fd (fd);
 
-  /* If such file is not found, don't progress further. */
-  if (file == NULL)
+  /* If such file is not found, or OFFSET is past any file's end,
+     don't progress further. */
+  if (file == NULL || offset > INT_MAX)
     return 0;
 
-  /* Write SIZE bytes from BUFFER to FILE.*/
-  lock_acquire (&filesys_lock);
-  int bytes_written = (int) file_write (file, buffer_indirect, size);
-  lock_release (&filesys_lock);
+  return read_iov (file, &iov, size, offset);
+}
+
+/* Write to a file at OFFSET, leaving its position alone. */
+static int
+pwrite (int fd, const void *buffer, unsigned size, unsigned offset)
+{
+  struct iovec iov;
+
+  if (!get_buffer (&iov, buffer, size))
+    return -1;
+
+  /* Find a file of FD. */
+  struct file *file = find_file_by_fd (fd);
 
-  return bytes_written;
+  /* If such file is not found, or OFFSET is past any file's end,
+     don't progress further. */
+  if (file == NULL || offset > INT_MAX)
+    return 0;
+
+  return write_iov (file, &iov, 1, offset);
 }
 
 /* Change position in a file. */
@@ -420,7 +781,7 @@ void
 seek (int fd, unsigned position)
 {
   /* Find a file of FD. */
-  struct file *file = find_file_by_fd (&thread_current ()->files, fd);
+  struct file *file = find_file_by_fd (fd);
 
   /* If such file is not found, don't progress further. */
   if (file == NULL)
@@ -428,9 +789,7 @@ seek (int fd, unsigned position)
 
   /* Sets the current position in FILE to POSITION bytes from the
      start of the file. */
-  lock_acquire (&filesys_lock);
   file_seek (file, (off_t) position);
-  lock_release (&filesys_lock);
 }
 
 /* Report current position in a file. */
@@ -438,16 +797,14 @@ unsigned
 tell (int fd)
 {
   /* Find a file of FD. */
-  struct file *file = find_file_by_fd (&thread_current ()->files, fd);
+  struct file *file = find_file_by_fd (fd);
 
   /* If such file is not found, don't progress further. */
   if (file == NULL)
     return 0;
 
   /* Remove the file from a list of files and close the file. */
-  lock_acquire (&filesys_lock);
   unsigned int position = file_tell (file);
-  lock_release (&filesys_lock);
 
   return position;
 }
@@ -457,19 +814,64 @@ void
 close (int fd)
 {
   /* Find a file of FD. */
-  struct file *file = find_file_by_fd (&thread_current ()->files, fd);
+  struct file *file = find_file_by_fd (fd);
 
   /* If such file is not found, don't progress further. */
   if (file == NULL)
     return;
 
-  /* Remove the file from a list of files and close the file. */
-  lock_acquire (&filesys_lock);
-  remove_file_by_fd (&thread_current ()->files, fd);
+  /* Remove the file from the file table and close the file. */
+  remove_file_by_fd (fd);
   file_close (file);
-  lock_release (&filesys_lock);
 }
 
+#ifdef VM
+/* Map a file into memory. */
+static mapid_t
+mmap (int fd, void *addr)
+{
+  /* Find a file of FD. */
+  struct file *file = find_file_by_fd (fd);
+
+  /* If such file is not found, don't progress further. */
+  if (file == NULL)
+    return MAP_FAILED;
+
+  return mmap_map (file, addr);
+}
+
+/* Remove a memory mapping. */
+static void
+munmap (mapid_t mapid)
+{
+  mmap_unmap (mapid);
+}
+
+/* Limit the process, and processes it starts later, to PAGES
+   resident pages, or remove the limit if PAGES is 0. */
+static void
+rsslimit (unsigned pages)
+{
+  thread_current ()->rss_limit = pages;
+}
+
+/* Count the process's resident pages. */
+static unsigned
+getrss (void)
+{
+  return thread_current ()->rss;
+}
+
+/* Estimate the process's working set, in pages. */
+static unsigned
+getwss (void)
+{
+  struct thread *cur = thread_current ();
+
+  return cur->wss < cur->rss ? cur->wss : cur->rss;
+}
+#endif
+
 /* Get n-th value of Fibonacci sequence. */
 static int
 fibonacci (int n)
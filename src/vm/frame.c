@@ -0,0 +1,1174 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/memprof.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/syscall.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* Frame table.
+
+   Every frame that holds a user page is on a single list, in
+   the order it was allocated.  When the user pool runs dry,
+   frame_alloc() takes a frame from some process by the
+   second-chance clock algorithm: a hand sweeps around the list,
+   clearing accessed bits, and stops at the first frame that has
+   not been accessed since the hand last passed it.  A dirty
+   victim is written back to its file if it is part of a mapped
+   file, or to swap otherwise; a clean one is dropped, since it
+   can be read from its file or zeroed again.  A frame shared
+   copy-on-write is accessed or dirty if it is through any of the
+   processes sharing it, and when it is evicted each of them gets
+   its own swap slot.
+
+   Read-only pages of executables are shared too, through the
+   text page cache, which maps each inode and offset to the frame
+   that holds it.  The first process to fault on such a page
+   reads it and enters its frame in the cache; later processes
+   running the same executable find it there and map it
+   read-only, so ten instances of a program hold one copy of its
+   code.  Such a frame is never dirty, so evicting it only drops
+   it from the cache, and it is freed along with its last page.
+   Running executables cannot be written, and a process frees
+   its frames before it lets its executable be written, so a
+   cached frame cannot go stale.  The cache holds a reference to
+   each inode in it, so that an inode cannot be freed and another
+   one allocated at its address while its frames are cached.
+
+   Each process may have a limit on its resident set, the number
+   of its pages in frames, counting shared frames once for each
+   process.  A process at its limit that needs a frame must first
+   give up some of its own.  When memory runs out, the clock
+   looks first for a frame of a process over its limit or over
+   its estimated working set, so that one process running through
+   more memory than it uses does not push everyone else out, and
+   only then at any frame.
+
+   The zero frame is a frame of zeros, never written, that any
+   zero-fill page may be mapped to read-only until it is written.
+   It is not on the frame list and does not keep a list of its
+   pages, and pages mapped to it do not count toward resident
+   sets.
+
+   So that faults seldom have to evict anything themselves, a
+   reclaim daemon keeps some user frames free.  When a frame
+   allocation leaves fewer than reclaim_low frames free, it wakes
+   the daemon, which runs the same clock, RECLAIM_BATCH frames at
+   a time, and frees the frames it evicts until reclaim_high are
+   free.
+
+   If enabled with "-ksm", a merge daemon also scans the frame
+   list, a few frames at a time, for frames of writable anonymous
+   or data pages with identical contents.  It write-protects each
+   frame it scans and enters it in the merge table, keyed by a
+   checksum of its contents and then by the contents themselves.
+   A frame that matches one already in the table has its pages
+   moved to that frame, read-only, and is freed; they are split
+   apart again by copy-on-write, like the frames of a forked
+   process.  A frame leaves the table when it becomes writable
+   again, is evicted, or is freed.
+
+   frame_lock protects the list, the caches, the resident set
+   sizes, and the link between each page and its frame or swap
+   slot.  A process that runs out of frames holds it across
+   eviction, I/O included, so a process that faults on a page
+   being evicted waits until the page has been written out.  The
+   reclaim daemon instead pins and unmaps a batch of victims,
+   marks them as being evicted, and drops the lock while it
+   writes them out; until it is done, their pages are its own,
+   and a thread that needs one of them waits on evict_cond.  If
+   writing a page out failed, it is mapped again by the time the
+   process gets frame_lock, so every function here that takes a
+   page that is not in memory checks again under the lock whether
+   it still is not.  A thread that
+   is writing a file may fault and need frame_lock, so eviction
+   only tries to write a mapped page back to its file, and passes
+   over dirty mapped pages when the file is busy. */
+
+static struct list frames;              /* All frames. */
+static struct list_elem *hand;          /* Clock hand, or list end. */
+static struct hash text_pages;          /* Cached text frames. */
+static struct hash ksm_frames;          /* Merge table. */
+static struct list_elem *ksm_cursor;    /* Merge daemon's position. */
+static struct lock frame_lock;          /* Protects the above. */
+static struct condition reclaim_cond;   /* Wakes the reclaim daemon. */
+static struct condition evict_cond;     /* Reclaim finished a batch. */
+static struct frame zero_frame;         /* Frame of zeros. */
+
+/* Free frame watermarks, in pages.  Controlled by kernel
+   command-line options "-rlow" and "-rhigh".  A low watermark of
+   0 turns the reclaim daemon off. */
+size_t reclaim_low = 8;
+size_t reclaim_high = 32;
+
+/* Frames the reclaim daemon evicts at a time. */
+#define RECLAIM_BATCH 8
+
+/* Frames the merge daemon scans per second, or 0 if it is off.
+   Controlled by kernel command-line option "-ksm". */
+size_t ksm_rate;
+
+/* Timer ticks the merge daemon sleeps between scans. */
+#define KSM_INTERVAL (TIMER_FREQ / 10)
+
+/* Statistics. */
+static long long evict_cnt;             /* Frames evicted. */
+static long long evict_budget_cnt;      /* ...from processes over budget. */
+static long long evict_trim_cnt;        /* ...to keep under RSS limits. */
+static long long reclaim_wake_cnt;      /* Reclaim daemon wakeups. */
+static long long reclaim_cnt;           /* Frames it freed. */
+static size_t zero_map_cnt;             /* Pages mapped to zero frame. */
+static size_t zero_map_peak;            /* Most at once. */
+static long long zero_copy_cnt;         /* Zero pages copied on write. */
+static long long ksm_scan_cnt;          /* Frames scanned for merging. */
+static long long ksm_merge_cnt;         /* Frames merged away. */
+static int64_t ksm_ticks;               /* Timer ticks spent scanning. */
+
+/* Chooses which frames evict() may take. */
+typedef bool frame_filter_func (struct frame *, struct thread *);
+
+static struct frame *get_frame (enum palloc_flags);
+static void attach (struct frame *, struct page *);
+static void detach (struct page *);
+static void trim (struct thread *);
+static thread_func reclaim_daemon;
+static void count_zero_map (void);
+static thread_func ksm_daemon;
+static void ksm_scan (struct frame *);
+static void ksm_forget (struct frame *);
+static hash_hash_func ksm_hash;
+static hash_less_func ksm_less;
+static frame_filter_func owned_by, over_budget, any_frame;
+static void map_page (struct page *, struct frame *, bool writable);
+static void free_frame (struct frame *);
+static struct frame *evict (frame_filter_func *, struct thread *);
+static struct frame *pick_victim (frame_filter_func *, struct thread *);
+static bool evict_frame (struct frame *);
+static void evict_start (struct frame *);
+static bool evict_write (struct frame *);
+static bool evict_finish (struct frame *, bool saved);
+static void wait_evicted (struct page *);
+static bool write_back (struct page *, const void *kpage);
+static struct frame *clock_next (void);
+static bool frame_is_accessed (struct frame *);
+static bool frame_is_dirty (struct frame *);
+static void uncache_text (struct frame *);
+static void disown_frame (struct frame *);
+static hash_hash_func text_hash;
+static hash_less_func text_less;
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  list_init (&frames);
+  hand = list_end (&frames);
+  ksm_cursor = list_end (&frames);
+  if (!hash_init (&text_pages, text_hash, text_less, NULL)
+      || !hash_init (&ksm_frames, ksm_hash, ksm_less, NULL))
+    PANIC ("frame table creation failed");
+  lock_init (&frame_lock);
+  cond_init (&reclaim_cond);
+  cond_init (&evict_cond);
+  zero_frame.kpage = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  memprof_disown (zero_frame.kpage);
+  list_init (&zero_frame.pages);
+  zero_frame.pinned = true;
+  zero_frame.evicting = false;
+  zero_frame.inode = NULL;
+  if (reclaim_low > 0
+      && thread_create ("reclaim", PRI_DEFAULT, reclaim_daemon, NULL)
+         == TID_ERROR)
+    PANIC ("reclaim daemon creation failed");
+  if (ksm_rate > 0
+      && thread_create ("ksm", PRI_DEFAULT, ksm_daemon, NULL) == TID_ERROR)
+    PANIC ("merge daemon creation failed");
+}
+
+/* Gets a frame from the user pool, with palloc flags FLAGS, to
+   hold page P of the running thread, evicting another page if
+   necessary.  The frame is returned pinned, so that it is not
+   evicted before the caller has filled it and mapped it; call
+   frame_unpin() when done.  Returns a null pointer if no frame
+   could be found.
+
+   If P is in a frame after all, because another thread failed to
+   evict it while we waited for frame_lock and mapped it again,
+   sets *RESIDENT to true and returns a null pointer, since there
+   is nothing to load.  Otherwise sets *RESIDENT to false. */
+struct frame *
+frame_alloc (struct page *p, enum palloc_flags flags, bool *resident)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  wait_evicted (p);
+  *resident = p->frame != NULL;
+  if (*resident)
+    {
+      lock_release (&frame_lock);
+      return NULL;
+    }
+
+  trim (p->thread);
+  f = get_frame (flags);
+  if (f != NULL)
+    attach (f, p);
+  lock_release (&frame_lock);
+
+  return f;
+}
+
+/* Pins the frame holding page P of the running thread, if it is
+   in memory, and returns it, or returns a null pointer if it is
+   not in memory.  Call frame_unpin() or frame_release() when
+   done. */
+struct frame *
+frame_pin (struct page *p)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  wait_evicted (p);
+  f = p->frame;
+  if (f != NULL)
+    {
+      ASSERT (!f->pinned);
+      f->pinned = true;
+    }
+  lock_release (&frame_lock);
+
+  return f;
+}
+
+/* Allows frame F to be evicted. */
+void
+frame_unpin (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  ASSERT (f->pinned);
+  f->pinned = false;
+  lock_release (&frame_lock);
+}
+
+/* Releases the frame or swap slot holding page P of the running
+   thread, unmapping it, when the page is going away.  A shared
+   frame is freed only when its last page is released. */
+void
+frame_release (struct page *p)
+{
+  struct frame *f;
+
+  ASSERT (p->thread == thread_current ());
+
+  lock_acquire (&frame_lock);
+  wait_evicted (p);
+  f = p->frame;
+  if (f == &zero_frame)
+    {
+      pagedir_clear_page (p->thread->pagedir, p->upage);
+      p->frame = NULL;
+      zero_map_cnt--;
+    }
+  else if (f != NULL)
+    {
+      pagedir_clear_page (p->thread->pagedir, p->upage);
+      detach (p);
+      if (list_empty (&f->pages))
+        free_frame (f);
+    }
+  if (p->swap_slot != SWAP_NONE)
+    {
+      swap_free (p->swap_slot);
+      p->swap_slot = SWAP_NONE;
+    }
+  lock_release (&frame_lock);
+}
+
+/* Gives page CHILD of the running thread, a newly forked child
+   process, the contents of PARENT, the same page in its parent.
+   If PARENT is in memory, its frame becomes shared copy-on-write
+   and is mapped read-only into both processes.  If it is in swap,
+   CHILD gets a copy of its swap slot.  Otherwise CHILD will be
+   loaded from its origin when touched, like PARENT.  Returns true
+   if successful, false if memory or swap ran out. */
+bool
+frame_share (struct page *parent, struct page *child)
+{
+  struct frame *f;
+  bool success = true;
+
+  ASSERT (child->thread == thread_current ());
+  ASSERT (child->frame == NULL && child->swap_slot == SWAP_NONE);
+
+  lock_acquire (&frame_lock);
+  wait_evicted (parent);
+  f = parent->frame;
+  if (f == &zero_frame)
+    {
+      success = pagedir_set_page (child->thread->pagedir, child->upage,
+                                  f->kpage, false);
+      if (success)
+        {
+          child->frame = f;
+          count_zero_map ();
+        }
+    }
+  else if (f != NULL)
+    {
+      uint32_t *parent_pd = parent->thread->pagedir;
+      uint32_t *child_pd = child->thread->pagedir;
+
+      success = pagedir_set_page (child_pd, child->upage, f->kpage, false);
+      if (success)
+        {
+          pagedir_set_writable (parent_pd, parent->upage, false);
+          pagedir_set_dirty (child_pd, child->upage,
+                             pagedir_is_dirty (parent_pd, parent->upage));
+          attach (f, child);
+          disown_frame (f);
+        }
+    }
+  else if (parent->swap_slot != SWAP_NONE)
+    {
+      child->swap_slot = swap_copy (parent->swap_slot);
+      success = child->swap_slot != SWAP_NONE;
+    }
+  lock_release (&frame_lock);
+
+  return success;
+}
+
+/* Resolves a write by the running thread to page P, which the
+   process may write but which is mapped read-only because its
+   frame is, or was, shared copy-on-write.  If other processes
+   still share the frame, P gets a private copy; otherwise it
+   keeps the frame, now writable.  Returns true if the write may
+   be retried, false if no frame was available for the copy. */
+bool
+frame_unshare (struct page *p)
+{
+  uint32_t *pd = p->thread->pagedir;
+  struct frame *f, *copy;
+  bool pinned;
+
+  ASSERT (p->thread == thread_current ());
+  ASSERT (p->writable);
+
+  lock_acquire (&frame_lock);
+  wait_evicted (p);
+  f = p->frame;
+  if (f == NULL)
+    {
+      /* Evicted since the fault.  Retrying faults it back in. */
+      lock_release (&frame_lock);
+      return true;
+    }
+
+  if (f != &zero_frame && list_size (&f->pages) == 1)
+    {
+      ksm_forget (f);
+      pagedir_set_writable (pd, p->upage, true);
+      lock_release (&frame_lock);
+      return true;
+    }
+
+  if (f == &zero_frame)
+    {
+      /* Give the page a zeroed frame of its own. */
+      trim (p->thread);
+      copy = get_frame (PAL_ZERO);
+      if (copy == NULL)
+        {
+          lock_release (&frame_lock);
+          return false;
+        }
+      zero_map_cnt--;
+      zero_copy_cnt++;
+      attach (copy, p);
+    }
+  else
+    {
+      /* Copy the frame, which must not be evicted meanwhile. */
+      pinned = f->pinned;
+      f->pinned = true;
+      copy = get_frame (0);
+      f->pinned = pinned;
+      if (copy == NULL)
+        {
+          lock_release (&frame_lock);
+          return false;
+        }
+      memcpy (copy->kpage, f->kpage, PGSIZE);
+      detach (p);
+      attach (copy, p);
+    }
+
+  /* The copy may differ from the page's origin, so it is dirty. */
+  pagedir_clear_page (pd, p->upage);
+  map_page (p, copy, true);
+  copy->pinned = false;
+  lock_release (&frame_lock);
+
+  return true;
+}
+
+/* Maps page P of the running thread, a zero-fill page that is
+   not mapped, read-only to the zero frame.  Returns true if
+   successful, false if memory ran out or P turns out to be in a
+   frame or in swap, because another thread was evicting it. */
+bool
+frame_share_zero (struct page *p)
+{
+  bool success = false;
+
+  ASSERT (p->thread == thread_current ());
+
+  lock_acquire (&frame_lock);
+  if (p->frame == NULL && p->swap_slot == SWAP_NONE)
+    success = pagedir_set_page (p->thread->pagedir, p->upage,
+                                zero_frame.kpage, false);
+  if (success)
+    {
+      p->frame = &zero_frame;
+      count_zero_map ();
+    }
+  lock_release (&frame_lock);
+
+  return success;
+}
+
+/* Maps page P of the running thread, a read-only page of its
+   executable, to the frame that holds the same bytes of the same
+   file for another process running it, if the text page cache
+   has one.  Returns true if successful, false if there is no
+   such frame, P is in a frame of its own already, or P could not
+   be mapped. */
+bool
+frame_share_text (struct page *p)
+{
+  struct frame key, *f;
+  struct hash_elem *e = NULL;
+  bool success = false;
+
+  ASSERT (p->thread == thread_current ());
+  ASSERT (!p->writable);
+
+  key.inode = file_get_inode (p->file);
+  key.ofs = p->ofs;
+
+  lock_acquire (&frame_lock);
+  if (p->frame == NULL)
+    e = hash_find (&text_pages, &key.text_elem);
+  if (e != NULL)
+    {
+      f = hash_entry (e, struct frame, text_elem);
+      if (f->read_bytes == p->read_bytes
+          && pagedir_set_page (p->thread->pagedir, p->upage, f->kpage, false))
+        {
+          attach (f, p);
+          success = true;
+        }
+    }
+  lock_release (&frame_lock);
+
+  return success;
+}
+
+/* Enters frame F, which holds page P of the running thread, a
+   read-only page of its executable just read from the file, in
+   the text page cache, so that other processes running the
+   executable can share it.  If another process cached the same
+   page first, F stays private to P. */
+void
+frame_cache_text (struct frame *f, struct page *p)
+{
+  ASSERT (p->frame == f && !p->writable);
+
+  lock_acquire (&frame_lock);
+  f->inode = file_get_inode (p->file);
+  f->ofs = p->ofs;
+  f->read_bytes = p->read_bytes;
+  if (hash_insert (&text_pages, &f->text_elem) != NULL)
+    f->inode = NULL;
+  else
+    {
+      inode_reopen (f->inode);
+      disown_frame (f);
+    }
+  lock_release (&frame_lock);
+}
+
+/* Acquires the frame table's lock, for callers outside this
+   file that look at pages' accessed bits; see
+   page_save_accessed(). */
+void
+frame_lock_acquire (void)
+{
+  lock_acquire (&frame_lock);
+}
+
+/* Releases the frame table's lock. */
+void
+frame_lock_release (void)
+{
+  lock_release (&frame_lock);
+}
+
+/* Returns true if the running thread holds the frame table's
+   lock. */
+bool
+frame_lock_held (void)
+{
+  return lock_held_by_current_thread (&frame_lock);
+}
+
+/* Prints eviction statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Eviction: %lld frames, %lld from processes over budget, "
+          "%lld to stay under limits\n",
+          evict_cnt, evict_budget_cnt, evict_trim_cnt);
+  printf ("Reclaim: %lld wakeups, %lld frames freed in background\n",
+          reclaim_wake_cnt, reclaim_cnt);
+  printf ("Zero frame: up to %zu pages mapped to it, %lld copied on write\n",
+          zero_map_peak, zero_copy_cnt);
+  printf ("Merging: %lld frames scanned in %lld ticks, %lld merged\n",
+          ksm_scan_cnt, ksm_ticks, ksm_merge_cnt);
+}
+
+/* Returns a frame with no pages, pinned, from the user pool or
+   by evicting a page, with palloc flags FLAGS.  Returns a null
+   pointer if none is available.  frame_lock must be held. */
+static struct frame *
+get_frame (enum palloc_flags flags)
+{
+  struct frame *f = NULL;
+  void *kpage;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  kpage = palloc_get_page (PAL_USER | (flags & PAL_ZERO));
+  if (kpage != NULL)
+    {
+      f = malloc (sizeof *f);
+      if (f != NULL)
+        {
+          f->kpage = kpage;
+          list_push_back (&frames, &f->elem);
+        }
+      else
+        palloc_free_page (kpage);
+    }
+  else
+    {
+      f = evict (over_budget, NULL);
+      if (f != NULL)
+        evict_budget_cnt++;
+      else
+        f = evict (any_frame, NULL);
+      if (f != NULL && (flags & PAL_ZERO))
+        memset (f->kpage, 0, PGSIZE);
+    }
+
+  if (f != NULL)
+    {
+      list_init (&f->pages);
+      f->pinned = true;
+      f->evicting = false;
+      f->inode = NULL;
+      f->ksm = false;
+    }
+  if (palloc_user_free () < reclaim_low)
+    cond_signal (&reclaim_cond, &frame_lock);
+  return f;
+}
+
+/* Adds page P to frame F's pages. */
+static void
+attach (struct frame *f, struct page *p)
+{
+  list_push_back (&f->pages, &p->frame_elem);
+  p->frame = f;
+  p->thread->rss++;
+}
+
+/* Removes page P from its frame's pages. */
+static void
+detach (struct page *p)
+{
+  list_remove (&p->frame_elem);
+  p->frame = NULL;
+  p->thread->rss--;
+}
+
+/* Evicts and frees frames of T's until T is under its resident
+   set limit, if it has one, or until none of its frames can be
+   evicted. */
+static void
+trim (struct thread *t)
+{
+  while (t->rss_limit != 0 && t->rss >= t->rss_limit)
+    {
+      struct frame *f = evict (owned_by, t);
+      if (f == NULL)
+        break;
+      evict_trim_cnt++;
+      free_frame (f);
+    }
+}
+
+/* Reclaim daemon.  Sleeps until get_frame() finds fewer than
+   reclaim_low user frames free, then evicts and frees frames
+   until reclaim_high are free or nothing more can be evicted.
+   It evicts RECLAIM_BATCH frames at a time, and does the I/O for
+   them without frame_lock, so that faulting processes are held
+   up only by the pages they need. */
+static void
+reclaim_daemon (void *aux UNUSED)
+{
+  lock_acquire (&frame_lock);
+  for (;;)
+    {
+      bool stuck = false;
+
+      cond_wait (&reclaim_cond, &frame_lock);
+      reclaim_wake_cnt++;
+      while (!stuck && palloc_user_free () < reclaim_high)
+        {
+          struct frame *victims[RECLAIM_BATCH];
+          bool saved[RECLAIM_BATCH];
+          size_t cnt, i;
+
+          /* Choose victims and unmap their pages. */
+          for (cnt = 0; cnt < RECLAIM_BATCH; cnt++)
+            {
+              struct frame *f = pick_victim (over_budget, NULL);
+
+              if (f == NULL)
+                f = pick_victim (any_frame, NULL);
+              if (f == NULL)
+                break;
+              f->pinned = f->evicting = true;
+              evict_start (f);
+              victims[cnt] = f;
+            }
+
+          /* Write them out without the lock. */
+          lock_release (&frame_lock);
+          for (i = 0; i < cnt; i++)
+            saved[i] = evict_write (victims[i]);
+          lock_acquire (&frame_lock);
+
+          /* Free those that were written out and put the rest
+             back. */
+          stuck = true;
+          for (i = 0; i < cnt; i++)
+            {
+              struct frame *f = victims[i];
+
+              f->pinned = f->evicting = false;
+              if (evict_finish (f, saved[i]))
+                {
+                  free_frame (f);
+                  evict_cnt++;
+                  reclaim_cnt++;
+                  stuck = false;
+                }
+            }
+          cond_broadcast (&evict_cond, &frame_lock);
+
+          lock_release (&frame_lock);
+          thread_yield ();
+          lock_acquire (&frame_lock);
+        }
+    }
+}
+
+/* Counts a page newly mapped to the zero frame. */
+static void
+count_zero_map (void)
+{
+  if (++zero_map_cnt > zero_map_peak)
+    zero_map_peak = zero_map_cnt;
+}
+
+/* Merge daemon.  Every KSM_INTERVAL ticks, scans the next few
+   frames on the frame list, enough to scan ksm_rate frames a
+   second. */
+static void
+ksm_daemon (void *aux UNUSED)
+{
+  size_t batch = ksm_rate * KSM_INTERVAL / TIMER_FREQ;
+
+  if (batch == 0)
+    batch = 1;
+  for (;;)
+    {
+      int64_t start;
+      size_t i;
+
+      timer_sleep (KSM_INTERVAL);
+
+      lock_acquire (&frame_lock);
+      start = timer_ticks ();
+      for (i = 0; i < batch && !list_empty (&frames); i++)
+        {
+          struct frame *f;
+
+          if (ksm_cursor == list_end (&frames))
+            ksm_cursor = list_begin (&frames);
+          f = list_entry (ksm_cursor, struct frame, elem);
+          ksm_cursor = list_next (ksm_cursor);
+          ksm_scan (f);
+        }
+      ksm_ticks += timer_elapsed (start);
+      lock_release (&frame_lock);
+    }
+}
+
+/* Scans frame F for merging, if it holds only writable pages
+   that are not part of mapped files and is not already in the
+   merge table: write-protects it and enters it in the table, or
+   merges it into an identical frame already there.  frame_lock
+   must be held. */
+static void
+ksm_scan (struct frame *f)
+{
+  struct list_elem *e;
+  struct hash_elem *match;
+  struct frame *g;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  if (f->pinned || f->ksm || f->inode != NULL || list_empty (&f->pages))
+    return;
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      if (!p->writable || p->mmap)
+        return;
+    }
+  ksm_scan_cnt++;
+
+  /* Write-protect the frame, so that its contents stay put while
+     it is in the table. */
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      pagedir_set_writable (p->thread->pagedir, p->upage, false);
+    }
+
+  f->ksm_sum = hash_bytes (f->kpage, PGSIZE);
+  match = hash_insert (&ksm_frames, &f->ksm_elem);
+  if (match == NULL)
+    {
+      f->ksm = true;
+      return;
+    }
+
+  /* Move F's pages to G, which has the same contents, and free F.
+     Each page's dirty bit still says whether it matches its
+     origin. */
+  g = hash_entry (match, struct frame, ksm_elem);
+  while (!list_empty (&f->pages))
+    {
+      struct page *p = list_entry (list_front (&f->pages),
+                                   struct page, frame_elem);
+      uint32_t *pd = p->thread->pagedir;
+      bool dirty = pagedir_is_dirty (pd, p->upage);
+
+      pagedir_clear_page (pd, p->upage);
+      if (!pagedir_set_page (pd, p->upage, g->kpage, false))
+        NOT_REACHED ();
+      pagedir_set_dirty (pd, p->upage, dirty);
+      detach (p);
+      attach (g, p);
+    }
+  disown_frame (g);
+  free_frame (f);
+  ksm_merge_cnt++;
+}
+
+/* Removes frame F from the merge table, if it is there. */
+static void
+ksm_forget (struct frame *f)
+{
+  if (f->ksm)
+    {
+      hash_delete (&ksm_frames, &f->ksm_elem);
+      f->ksm = false;
+    }
+}
+
+/* Maps page P into its process's page directory at frame F,
+   writable if WRITABLE, and marks it dirty.  P was mapped
+   before, so its page table exists and this cannot fail. */
+static void
+map_page (struct page *p, struct frame *f, bool writable)
+{
+  uint32_t *pd = p->thread->pagedir;
+
+  if (!pagedir_set_page (pd, p->upage, f->kpage, writable))
+    NOT_REACHED ();
+  pagedir_set_dirty (pd, p->upage, true);
+}
+
+/* Removes frame F, which holds no pages, from the frame table and
+   frees it. */
+static void
+free_frame (struct frame *f)
+{
+  ASSERT (list_empty (&f->pages));
+
+  uncache_text (f);
+  ksm_forget (f);
+  if (hand == &f->elem)
+    hand = list_next (hand);
+  if (ksm_cursor == &f->elem)
+    ksm_cursor = list_next (ksm_cursor);
+  list_remove (&f->elem);
+  palloc_free_page (f->kpage);
+  free (f);
+}
+
+/* Chooses a frame for which FILTER returns true, given T, by
+   the clock algorithm, and evicts its pages.  Returns the frame,
+   which is still on the frame list, or a null pointer if no
+   frame could be evicted.  frame_lock must be held. */
+static struct frame *
+evict (frame_filter_func *filter, struct thread *t)
+{
+  size_t i, n;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  /* Two trips around the clock clear every accessed bit on the
+     first and find a victim on the second, unless every frame
+     is pinned or cannot be written out. */
+  n = 2 * list_size (&frames);
+  for (i = 0; i < n; i++)
+    {
+      struct frame *f = clock_next ();
+
+      if (!f->pinned && filter (f, t) && !frame_is_accessed (f)
+          && evict_frame (f))
+        {
+          evict_cnt++;
+          return f;
+        }
+    }
+  return NULL;
+}
+
+/* Chooses a frame for which FILTER returns true, given T, by
+   the clock algorithm, as evict() does, but returns it without
+   evicting it, or returns a null pointer if there is none.
+   frame_lock must be held. */
+static struct frame *
+pick_victim (frame_filter_func *filter, struct thread *t)
+{
+  size_t i, n;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  n = 2 * list_size (&frames);
+  for (i = 0; i < n; i++)
+    {
+      struct frame *f = clock_next ();
+
+      if (!f->pinned && filter (f, t) && !frame_is_accessed (f))
+        return f;
+    }
+  return NULL;
+}
+
+/* Evicts the pages in frame F, writing them to their file or to
+   swap if the frame is dirty.  Returns true if successful, false
+   if it is dirty and could not be written out.  frame_lock must
+   be held. */
+static bool
+evict_frame (struct frame *f)
+{
+  evict_start (f);
+  return evict_finish (f, evict_write (f));
+}
+
+/* Begins evicting frame F: takes it out of the caches and
+   unmaps its pages, so that no process can dirty the frame after
+   we look at the dirty bits.  A frame in the text page cache is
+   never dirty, so its eviction cannot fail and it is dropped
+   from the cache now.  frame_lock must be held. */
+static void
+evict_start (struct frame *f)
+{
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  /* If eviction fails, the pages may be mapped writable again. */
+  ksm_forget (f);
+  uncache_text (f);
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      pagedir_clear_page (p->thread->pagedir, p->upage);
+    }
+}
+
+/* Writes the pages in frame F, whose eviction has begun, to
+   their file or to swap if the frame is dirty.  Returns true if
+   successful, false if they could not all be written out.  May be
+   called without frame_lock if F is marked as being evicted. */
+static bool
+evict_write (struct frame *f)
+{
+  struct list_elem *e;
+  bool saved = true;
+
+  if (frame_is_dirty (f))
+    for (e = list_begin (&f->pages); saved && e != list_end (&f->pages);
+         e = list_next (e))
+      {
+        struct page *p = list_entry (e, struct page, frame_elem);
+
+        if (p->mmap)
+          saved = write_back (p, f->kpage);
+        else
+          {
+            p->swap_slot = swap_out (f->kpage);
+            saved = p->swap_slot != SWAP_NONE;
+          }
+      }
+  return saved;
+}
+
+/* Finishes evicting frame F.  If SAVED, the pages were written
+   out, so detaches them from F; otherwise gives back the swap
+   slots taken for them and maps them at F again.  Returns
+   SAVED.  frame_lock must be held. */
+static bool
+evict_finish (struct frame *f, bool saved)
+{
+  struct list_elem *e;
+  bool shared = list_size (&f->pages) > 1;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  if (!saved)
+    {
+      for (e = list_begin (&f->pages); e != list_end (&f->pages);
+           e = list_next (e))
+        {
+          struct page *p = list_entry (e, struct page, frame_elem);
+          if (p->swap_slot != SWAP_NONE)
+            {
+              swap_free (p->swap_slot);
+              p->swap_slot = SWAP_NONE;
+            }
+          map_page (p, f, p->writable && !shared);
+        }
+      return false;
+    }
+
+  while (!list_empty (&f->pages))
+    detach (list_entry (list_front (&f->pages), struct page, frame_elem));
+  return true;
+}
+
+/* Waits until the reclaim daemon has finished evicting the frame
+   that holds page P, if it is evicting it.  Afterward P is either
+   in memory again or no longer in a frame.  frame_lock must be
+   held. */
+static void
+wait_evicted (struct page *p)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  while (p->frame != NULL && p->frame->evicting)
+    cond_wait (&evict_cond, &frame_lock);
+}
+
+/* Returns true if every page in frame F belongs to T. */
+static bool
+owned_by (struct frame *f, struct thread *t)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    if (list_entry (e, struct page, frame_elem)->thread != t)
+      return false;
+  return true;
+}
+
+/* Returns true if some page in frame F belongs to a process that
+   is over its resident set limit or its working set estimate. */
+static bool
+over_budget (struct frame *f, struct thread *t UNUSED)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct thread *owner = list_entry (e, struct page, frame_elem)->thread;
+
+      if ((owner->rss_limit != 0 && owner->rss > owner->rss_limit)
+          || owner->rss > owner->wss)
+        return true;
+    }
+  return false;
+}
+
+/* Returns true. */
+static bool
+any_frame (struct frame *f UNUSED, struct thread *t UNUSED)
+{
+  return true;
+}
+
+/* Writes mapped page P, held in KPAGE, back to its file.  Returns
+   true if successful, false if the file is being written. */
+static bool
+write_back (struct page *p, const void *kpage)
+{
+  return file_try_write_at (p->file, kpage, p->read_bytes, p->ofs) >= 0;
+}
+
+/* Advances the clock hand and returns the frame it passed.
+   The frame list must not be empty. */
+static struct frame *
+clock_next (void)
+{
+  struct frame *f;
+
+  ASSERT (!list_empty (&frames));
+
+  if (hand == list_end (&frames))
+    hand = list_begin (&frames);
+  f = list_entry (hand, struct frame, elem);
+  hand = list_next (hand);
+  return f;
+}
+
+/* Returns true if any process sharing frame F has accessed it
+   since the hand last passed, and clears its accessed bits,
+   saving them for the working set sampler. */
+static bool
+frame_is_accessed (struct frame *f)
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+
+      page_save_accessed (p);
+      if (p->clock_ref)
+        {
+          accessed = true;
+          p->clock_ref = false;
+        }
+    }
+  return accessed;
+}
+
+/* Returns true if any process sharing frame F has modified it. */
+static bool
+frame_is_dirty (struct frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      if (pagedir_is_dirty (p->thread->pagedir, p->upage))
+        return true;
+    }
+  return false;
+}
+
+/* Removes frame F from the text page cache, if it is there,
+   and drops the cache's reference to its inode. */
+static void
+uncache_text (struct frame *f)
+{
+  if (f->inode != NULL)
+    {
+      hash_delete (&text_pages, &f->text_elem);
+      inode_close (f->inode);
+      f->inode = NULL;
+    }
+}
+
+/* Tells the memory profiler that frame F, which has become
+   shared among processes, no longer belongs to the thread that
+   allocated it, so that it is not reported as a leak when that
+   thread exits. */
+static void
+disown_frame (struct frame *f)
+{
+  memprof_disown (f->kpage);
+  memprof_disown (f);
+}
+
+/* Returns a hash value for the text cached in frame F. */
+static unsigned
+text_hash (const struct hash_elem *f_, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (f_, struct frame, text_elem);
+  return hash_bytes (&f->inode, sizeof f->inode) ^ hash_int (f->ofs);
+}
+
+/* Returns true if the text cached in frame A precedes that in
+   frame B. */
+static bool
+text_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, text_elem);
+  const struct frame *b = hash_entry (b_, struct frame, text_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  return a->ofs < b->ofs;
+}
+
+/* Returns a hash value for the contents of frame F. */
+static unsigned
+ksm_hash (const struct hash_elem *f_, void *aux UNUSED)
+{
+  return hash_entry (f_, struct frame, ksm_elem)->ksm_sum;
+}
+
+/* Returns true if the contents of frame A precede those of
+   frame B, comparing their checksums first. */
+static bool
+ksm_less (const struct hash_elem *a_, const struct hash_elem *b_,
+          void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, ksm_elem);
+  const struct frame *b = hash_entry (b_, struct frame, ksm_elem);
+
+  if (a->ksm_sum != b->ksm_sum)
+    return a->ksm_sum < b->ksm_sum;
+  return memcmp (a->kpage, b->kpage, PGSIZE) < 0;
+}
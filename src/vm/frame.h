@@ -0,0 +1,68 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include "filesys/off_t.h"
+#include "threads/palloc.h"
+
+struct page;
+
+/* A physical frame holding a user page.
+
+   After fork(), parent and child share the frames of their
+   pages copy-on-write: each frame is mapped read-only by every
+   process whose page it holds, and PAGES, whose length is the
+   frame's reference count, lists those pages.  The first process
+   to write to a shared frame gets a copy of its own.
+
+   A frame holding a read-only page of an executable is also
+   entered in a cache keyed by INODE and OFS, so that every
+   process running the executable maps the same frame.  The merge
+   daemon may share a frame among processes whose pages it finds
+   to be identical, copy-on-write. */
+struct frame
+  {
+    void *kpage;                /* Kernel virtual address. */
+    struct list pages;          /* Pages held, one per process. */
+    bool pinned;                /* True if it must not be evicted. */
+    bool evicting;              /* True while reclaim writes it out. */
+    struct inode *inode;        /* Cached text's inode, or null. */
+    off_t ofs;                  /* Offset of cached text in INODE. */
+    size_t read_bytes;          /* Bytes of INODE; rest are zero. */
+    struct hash_elem text_elem; /* Element in text page cache. */
+    bool ksm;                   /* True if in merge table. */
+    unsigned ksm_sum;           /* Checksum of contents, if KSM. */
+    struct hash_elem ksm_elem;  /* Element in merge table. */
+    struct list_elem elem;      /* Element in frame list. */
+  };
+
+/* Free frame watermarks, in pages. */
+extern size_t reclaim_low;
+extern size_t reclaim_high;
+
+/* Frames the merge daemon scans per second, or 0 if off. */
+extern size_t ksm_rate;
+
+void frame_init (void);
+struct frame *frame_alloc (struct page *, enum palloc_flags,
+                           bool *resident);
+struct frame *frame_pin (struct page *);
+void frame_unpin (struct frame *);
+void frame_release (struct page *);
+
+bool frame_share (struct page *parent, struct page *child);
+bool frame_unshare (struct page *);
+
+bool frame_share_zero (struct page *);
+bool frame_share_text (struct page *);
+void frame_cache_text (struct frame *, struct page *);
+
+void frame_lock_acquire (void);
+void frame_lock_release (void);
+bool frame_lock_held (void);
+
+void frame_print_stats (void);
+
+#endif /* vm/frame.h */
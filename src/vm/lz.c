@@ -0,0 +1,144 @@
+#include "vm/lz.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* A small LZ77 compressor, in the style of LZ4 and LZRW1.
+
+   It trades compression ratio for speed: one pass, one hash
+   probe per input byte, no search for a longer match.  The
+   compressed data is a sequence of tokens, each starting with a
+   control byte:
+
+     - 0xxxxxxx: a literal run.  The next x + 1 bytes (1 to 128)
+       are copied to the output.
+
+     - 1xxxxxxx: a match.  The next two bytes, little-endian, are
+       an offset back into the output already produced; x +
+       LZ_MIN_MATCH bytes (3 to 130) are copied from there.  The
+       source and destination may overlap, so a run of one byte
+       value takes one literal and a few matches. */
+
+#define LZ_MIN_MATCH 3                          /* Shortest match. */
+#define LZ_MAX_MATCH (0x7f + LZ_MIN_MATCH)      /* Longest match. */
+#define LZ_MAX_LITERALS 0x80                    /* Longest literal run. */
+
+static bool emit_literals (const uint8_t *, size_t cnt,
+                           uint8_t *dst, size_t *dst_ofs, size_t dst_size);
+static unsigned hash3 (const uint8_t *);
+
+/* Compresses the SIZE bytes at SRC into DST, which has room for
+   DST_SIZE bytes, and returns the number of bytes written, or 0
+   if the data did not fit.  HASH is scratch space, which need
+   not be initialized: it is only used to guess where matches
+   might be, and each guess is checked. */
+size_t
+lz_compress (const uint8_t *src, size_t size, uint8_t *dst, size_t dst_size,
+             uint16_t hash[LZ_HASH_SIZE])
+{
+  size_t ip = 0;                /* Next input byte. */
+  size_t lit = 0;               /* First input byte not yet emitted. */
+  size_t op = 0;                /* Next output byte. */
+
+  ASSERT (size <= UINT16_MAX);
+
+  while (ip + LZ_MIN_MATCH <= size)
+    {
+      unsigned h = hash3 (src + ip);
+      size_t cand = hash[h];
+
+      hash[h] = ip;
+      if (cand < ip && !memcmp (src + cand, src + ip, LZ_MIN_MATCH))
+        {
+          size_t len = LZ_MIN_MATCH;
+          size_t ofs = ip - cand;
+
+          while (ip + len < size && len < LZ_MAX_MATCH
+                 && src[cand + len] == src[ip + len])
+            len++;
+
+          if (!emit_literals (src + lit, ip - lit, dst, &op, dst_size)
+              || op + 3 > dst_size)
+            return 0;
+          dst[op++] = 0x80 | (len - LZ_MIN_MATCH);
+          dst[op++] = ofs & 0xff;
+          dst[op++] = ofs >> 8;
+          ip += len;
+          lit = ip;
+        }
+      else
+        ip++;
+    }
+
+  if (!emit_literals (src + lit, size - lit, dst, &op, dst_size))
+    return 0;
+  return op;
+}
+
+/* Decompresses the SRC_SIZE bytes at SRC, written by
+   lz_compress(), into the SIZE bytes at DST, which is how much
+   they decompress to. */
+void
+lz_decompress (const uint8_t *src, size_t src_size, uint8_t *dst, size_t size)
+{
+  const uint8_t *end = src + src_size;
+  size_t op = 0;
+
+  while (src < end)
+    {
+      unsigned c = *src++;
+
+      if (c & 0x80)
+        {
+          size_t len = (c & 0x7f) + LZ_MIN_MATCH;
+          size_t ofs = src[0] | (src[1] << 8);
+
+          src += 2;
+          ASSERT (ofs > 0 && ofs <= op && op + len <= size);
+          for (; len > 0; len--, op++)
+            dst[op] = dst[op - ofs];
+        }
+      else
+        {
+          size_t len = c + 1;
+
+          ASSERT (src + len <= end && op + len <= size);
+          memcpy (dst + op, src, len);
+          src += len;
+          op += len;
+        }
+    }
+  ASSERT (op == size);
+}
+
+/* Appends the CNT bytes at LITERALS to DST, which has room for
+   DST_SIZE bytes, starting at *DST_OFS, as literal runs, and
+   advances *DST_OFS past them.  Returns true if successful,
+   false if they did not fit. */
+static bool
+emit_literals (const uint8_t *literals, size_t cnt,
+               uint8_t *dst, size_t *dst_ofs, size_t dst_size)
+{
+  while (cnt > 0)
+    {
+      size_t run = cnt < LZ_MAX_LITERALS ? cnt : LZ_MAX_LITERALS;
+
+      if (*dst_ofs + 1 + run > dst_size)
+        return false;
+      dst[(*dst_ofs)++] = run - 1;
+      memcpy (dst + *dst_ofs, literals, run);
+      *dst_ofs += run;
+      literals += run;
+      cnt -= run;
+    }
+  return true;
+}
+
+/* Returns a hash of the LZ_MIN_MATCH bytes at P, an index into
+   the hash table. */
+static unsigned
+hash3 (const uint8_t *p)
+{
+  uint32_t x = p[0] | (p[1] << 8) | ((uint32_t) p[2] << 16);
+  return (x * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
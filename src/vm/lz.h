@@ -0,0 +1,18 @@
+#ifndef VM_LZ_H
+#define VM_LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Entries in the hash table that lz_compress() uses to find
+   matches. */
+#define LZ_HASH_BITS 12
+#define LZ_HASH_SIZE (1 << LZ_HASH_BITS)
+
+size_t lz_compress (const uint8_t *src, size_t size,
+                    uint8_t *dst, size_t dst_size,
+                    uint16_t hash[LZ_HASH_SIZE]);
+void lz_decompress (const uint8_t *src, size_t src_size,
+                    uint8_t *dst, size_t size);
+
+#endif /* vm/lz.h */
@@ -0,0 +1,132 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <round.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/syscall.h"
+#include "vm/page.h"
+
+/* Memory-mapped files.
+
+   A mapping is a run of pages in the supplemental page table
+   that are read from a file when first touched, like the pages
+   of an executable, except that they are written back to the
+   file instead of to swap: when evicted, when unmapped, and when
+   the process exits. */
+
+static void unmap (struct mapping *);
+
+/* Maps FILE into the running process's address space starting at
+   ADDR, and returns the new mapping's identifier.  The mapping
+   keeps its own handle on FILE, so the caller may close FILE
+   afterward.  Returns MAP_FAILED if ADDR is null or not page
+   aligned, if FILE is empty, if any page of the mapping would
+   overlap pages the process already has or the region its stack
+   may grow into, or if memory allocation fails. */
+mapid_t
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  uint8_t *stack_floor;
+  struct mapping *m;
+  off_t length;
+  size_t i;
+
+  if (addr == NULL || pg_ofs (addr) != 0)
+    return MAP_FAILED;
+
+  length = file_length (file);
+  if (length == 0)
+    return MAP_FAILED;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return MAP_FAILED;
+  m->addr = addr;
+  m->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+
+  /* Check that the pages are free and clear of the stack. */
+  stack_floor = (uint8_t *) PHYS_BASE - stack_page_limit * PGSIZE;
+  if ((uint8_t *) addr >= stack_floor
+      || m->page_cnt > (size_t) (stack_floor - (uint8_t *) addr) / PGSIZE)
+    goto fail;
+  for (i = 0; i < m->page_cnt; i++)
+    if (page_lookup ((uint8_t *) addr + i * PGSIZE) != NULL)
+      goto fail;
+
+  m->file = file_reopen (file);
+  if (m->file == NULL)
+    goto fail;
+
+  /* Record the pages. */
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      off_t ofs = i * PGSIZE;
+      size_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+      if (!page_add_mmap ((uint8_t *) addr + ofs, m->file, ofs, read_bytes))
+        {
+          m->page_cnt = i;
+          unmap (m);
+          return MAP_FAILED;
+        }
+    }
+
+  m->id = t->next_mapid++;
+  list_push_back (&t->mappings, &m->elem);
+  return m->id;
+
+ fail:
+  free (m);
+  return MAP_FAILED;
+}
+
+/* Unmaps the running process's mapping MAPID, writing pages it
+   modified back to the file.  Does nothing if there is no such
+   mapping. */
+void
+mmap_unmap (mapid_t mapid)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == mapid)
+        {
+          list_remove (e);
+          unmap (m);
+          return;
+        }
+    }
+}
+
+/* Unmaps all of the running process's mappings, writing modified
+   pages back.  Called when the process exits. */
+void
+mmap_unmap_all (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mappings))
+    unmap (list_entry (list_pop_front (&t->mappings),
+                       struct mapping, elem));
+}
+
+/* Removes M's pages, writing modified ones back, and frees M.
+   M must not be on the process's list of mappings. */
+static void
+unmap (struct mapping *m)
+{
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++)
+    page_remove ((uint8_t *) m->addr + i * PGSIZE);
+
+  file_close (m->file);
+  free (m);
+}
@@ -0,0 +1,598 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/syscall.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/* Supplemental page tables.
+
+   Each user process has a hash table, keyed by user virtual
+   address, of the pages that load() promised it.  Loading an
+   executable only fills in this table; the pages themselves are
+   read or zeroed one at a time as the process faults on them, so
+   the cost of starting a process no longer grows with the size
+   of its executable, only with the part of it that runs.  Pages
+   evicted to swap, and pages of memory-mapped files, are read in
+   the same way.
+
+   To take fewer faults, a fault also brings in some of the
+   faulting page's neighbors.  Text pages that other processes
+   already hold are mapped from the text page cache, which costs
+   no I/O, and a process that is scanning forward through its
+   pages has the next few read ahead, as many as proved useful
+   last time.  Pages read ahead are mapped with their accessed
+   bits clear, so the clock takes back unused ones first.
+
+   Zero-fill pages, such as BSS and new stack pages, that are
+   read before they are written are mapped read-only to the
+   shared zero frame, and only get a frame of their own, through
+   page_unshare(), when first written.
+
+   A process that faults also samples its working set, at most
+   once every WSS_INTERVAL ticks: the pages it accessed since the
+   last sample, averaged with the previous estimate.  Until the
+   first sample, the whole resident set is taken to be the
+   working set.  The frame table evicts first from processes
+   whose resident set exceeds this estimate. */
+
+/* Largest user stack, in pages: 8 MB by default. */
+size_t stack_page_limit = 2048;
+
+/* Timer ticks between samples of a process's working set. */
+#define WSS_INTERVAL TIMER_FREQ
+
+/* Largest block of pages mapped on one fault. */
+#define FAULT_AROUND_PAGES 16
+
+/* Statistics. */
+static long long read_ahead_cnt;        /* Pages read ahead. */
+static long long read_ahead_used_cnt;   /* Of those, seen to be used. */
+static long long mapped_around_cnt;     /* Text pages mapped around. */
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static void page_free (struct hash_elem *, void *aux);
+static bool page_add (void *upage, struct file *, off_t ofs,
+                      size_t read_bytes, bool writable, bool mmap);
+static bool is_text (const struct page *);
+static bool is_zero (const struct page *);
+static struct frame *load_page (struct page *, bool *resident);
+static void map_around (struct page *);
+static void read_ahead (struct page *);
+static void sample_working_set (void);
+
+/* Creates an empty supplemental page table for the running
+   thread.  Returns true if successful, false if memory
+   allocation failed. */
+bool
+page_table_create (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->pages == NULL);
+
+  t->pages = malloc (sizeof *t->pages);
+  if (t->pages == NULL)
+    return false;
+  if (!hash_init (t->pages, page_hash, page_less, NULL))
+    {
+      free (t->pages);
+      t->pages = NULL;
+      return false;
+    }
+  t->ra_start = t->ra_next = NULL;
+  t->ra_window = 1;
+  t->wss = SIZE_MAX;
+  t->wss_sampled = timer_ticks ();
+  return true;
+}
+
+/* Copies the supplemental page table of PARENT into that of the
+   running thread, a child PARENT is forking, which must have a
+   page table, a page directory, and its own handle on PARENT's
+   executable.  Pages in memory become shared copy-on-write.
+   Memory-mapped files are not inherited.  PARENT must be blocked
+   until the copy is done.  Returns true if successful, false if
+   memory or swap ran out. */
+bool
+page_table_copy (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+
+  ASSERT (t->pages != NULL && t->pagedir != NULL);
+  ASSERT (t->elf_executable != NULL);
+
+  hash_first (&i, parent->pages);
+  while (hash_next (&i))
+    {
+      struct page *pp = hash_entry (hash_cur (&i), struct page, elem);
+      struct page *cp;
+
+      if (pp->mmap)
+        continue;
+
+      /* Pages that are not mapped files come from the executable,
+         if from any file. */
+      ASSERT (pp->file == NULL || pp->file == parent->elf_executable);
+      if (!page_add (pp->upage, pp->file != NULL ? t->elf_executable : NULL,
+                     pp->ofs, pp->read_bytes, pp->writable, false))
+        return false;
+      cp = page_lookup (pp->upage);
+      if (!frame_share (pp, cp))
+        return false;
+    }
+  return true;
+}
+
+/* Destroys the running thread's supplemental page table, if it
+   has one, freeing the frames and swap slots that hold its
+   pages.  This must happen before the page directory is
+   destroyed. */
+void
+page_table_destroy (void)
+{
+  struct thread *t = thread_current ();
+
+  if (t->pages == NULL)
+    return;
+  hash_destroy (t->pages, page_free);
+  free (t->pages);
+  t->pages = NULL;
+}
+
+/* Records that user page UPAGE of the running process holds
+   READ_BYTES bytes read from FILE starting at offset OFS,
+   followed by zeros to the end of the page.  The process may
+   write the page if WRITABLE is true.  Returns true if
+   successful, false if UPAGE is already recorded or memory
+   allocation failed. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes, bool writable)
+{
+  ASSERT (file != NULL);
+  ASSERT (read_bytes <= PGSIZE);
+
+  return page_add (upage, file, ofs, read_bytes, writable, false);
+}
+
+/* Records that user page UPAGE of the running process starts out
+   full of zeros.  Returns true if successful, false if UPAGE is
+   already recorded or memory allocation failed. */
+bool
+page_add_zero (void *upage, bool writable)
+{
+  return page_add (upage, NULL, 0, 0, writable, false);
+}
+
+/* Records that user page UPAGE of the running process maps
+   READ_BYTES bytes of FILE starting at offset OFS, followed by
+   zeros to the end of the page.  The page is writable, and
+   changes to it are written back to FILE.  Returns true if
+   successful, false if UPAGE is already recorded or memory
+   allocation failed. */
+bool
+page_add_mmap (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes)
+{
+  ASSERT (file != NULL);
+  ASSERT (read_bytes > 0 && read_bytes <= PGSIZE);
+
+  return page_add (upage, file, ofs, read_bytes, true, true);
+}
+
+/* Removes the running process's page UPAGE, which must exist,
+   unmapping it and freeing its frame or swap slot.  If it is a
+   page of a mapped file and the process modified it, it is first
+   written back. */
+void
+page_remove (void *upage)
+{
+  struct thread *t = thread_current ();
+  struct page *p = page_lookup (upage);
+  struct frame *f;
+
+  ASSERT (p != NULL);
+
+  hash_delete (t->pages, &p->elem);
+  if (p->mmap && (f = frame_pin (p)) != NULL
+      && pagedir_is_dirty (t->pagedir, p->upage))
+    file_write_at (p->file, f->kpage, p->read_bytes, p->ofs);
+  frame_release (p);
+  free (p);
+}
+
+/* Returns the running process's record of the page containing
+   UPAGE, or a null pointer if there is none. */
+struct page *
+page_lookup (const void *upage)
+{
+  struct thread *t = thread_current ();
+  struct page p;
+  struct hash_elem *e;
+
+  if (t->pages == NULL)
+    return NULL;
+
+  p.upage = pg_round_down (upage);
+  e = hash_find (t->pages, &p.elem);
+  return e != NULL ? hash_entry (e, struct page, elem) : NULL;
+}
+
+/* Brings in the page containing FAULT_ADDR, which the running
+   process touched, writing if WRITE is true, but which is not
+   mapped, and perhaps some of its neighbors.  Returns true if
+   the page was loaded and mapped, false if the process has no
+   such page or it could not be loaded.
+
+   May be called in the middle of a file system call, when the
+   kernel faults on a user buffer. */
+bool
+page_fault_in (const void *fault_addr, bool write)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+  struct frame *f;
+  bool resident;
+
+  p = page_lookup (fault_addr);
+  if (p == NULL || pagedir_get_page (t->pagedir, p->upage) != NULL)
+    return false;
+  sample_working_set ();
+
+  /* Reading a page that starts out zeroed needs no frame of its
+     own until it is written. */
+  if (!write && is_zero (p) && frame_share_zero (p))
+    {
+      read_ahead (p);
+      return true;
+    }
+
+  /* Code and other read-only parts of the executable may already
+     be in memory for another process running it, and then so are
+     their neighbors, most likely. */
+  if (is_text (p) && frame_share_text (p))
+    {
+      map_around (p);
+      return true;
+    }
+
+  f = load_page (p, &resident);
+  if (f == NULL)
+    return resident;
+  if (is_text (p))
+    map_around (p);
+  read_ahead (p);
+  frame_unpin (f);
+  return true;
+}
+
+/* Grows the running process's stack to cover FAULT_ADDR, which
+   it touched but which is not mapped, if FAULT_ADDR looks like a
+   stack access: one no more than 32 bytes below ESP, the user
+   stack pointer, which is as far below it as PUSHA writes, and
+   within stack_page_limit pages of the top of user memory.  The
+   stack grows by the one page touched.  Returns true if the page
+   was added and mapped, false otherwise. */
+bool
+page_grow_stack (const void *fault_addr, const void *esp)
+{
+  uint8_t *upage = pg_round_down (fault_addr);
+
+  if ((const uint8_t *) fault_addr < (const uint8_t *) esp - 32
+      || (size_t) ((uint8_t *) PHYS_BASE - upage) > stack_page_limit * PGSIZE)
+    return false;
+  return page_add_zero (upage, true) && page_fault_in (upage, true);
+}
+
+/* Resolves a write by the running process to the page at
+   FAULT_ADDR, which is mapped read-only, if the page is writable
+   and was shared copy-on-write by fork() or mapped to the zero
+   frame.  Returns true if the write may be retried, false if it
+   is a real protection violation or memory ran out. */
+bool
+page_unshare (const void *fault_addr)
+{
+  struct page *p = page_lookup (fault_addr);
+
+  return p != NULL && p->writable && frame_unshare (p);
+}
+
+/* Gets a frame for page P of the running process, fills it
+   from P's file or swap slot or with zeros, and maps it.
+   Returns the frame, still pinned, or a null pointer if no frame
+   was available or P could not be read.  Sets *RESIDENT to true
+   if P needed no loading after all, as frame_alloc() does. */
+static struct frame *
+load_page (struct page *p, bool *resident)
+{
+  struct thread *t = thread_current ();
+  struct frame *f;
+  bool from_swap;
+  bool success = true;
+
+  /* Get a frame.  Zero-fill pages come from palloc already
+     cleared. */
+  f = frame_alloc (p, (p->swap_slot == SWAP_NONE && p->read_bytes == 0
+                       ? PAL_ZERO : 0), resident);
+  if (f == NULL)
+    return NULL;
+
+  /* Fill it. */
+  from_swap = p->swap_slot != SWAP_NONE;
+  if (from_swap)
+    {
+      swap_in (p->swap_slot, f->kpage);
+      p->swap_slot = SWAP_NONE;
+    }
+  else if (p->read_bytes > 0)
+    {
+      success = (file_read_at (p->file, f->kpage, p->read_bytes, p->ofs)
+                 == (off_t) p->read_bytes);
+      memset ((uint8_t *) f->kpage + p->read_bytes, 0,
+              PGSIZE - p->read_bytes);
+    }
+
+  /* Map it.  A page that came back from swap no longer matches
+     its file, so mark it dirty to send it back to swap if it is
+     evicted again. */
+  if (success)
+    success = pagedir_set_page (t->pagedir, p->upage, f->kpage,
+                                p->writable);
+  if (!success)
+    {
+      frame_unpin (f);
+      frame_release (p);
+      return NULL;
+    }
+  if (from_swap)
+    pagedir_set_dirty (t->pagedir, p->upage, true);
+  if (is_text (p))
+    frame_cache_text (f, p);
+  return f;
+}
+
+/* Maps the running process's text pages in the
+   FAULT_AROUND_PAGES-page block around text page P that other
+   processes already hold in the text page cache.  No I/O is
+   done. */
+static void
+map_around (struct page *p)
+{
+  struct thread *t = thread_current ();
+  uint8_t *start = (uint8_t *) ((uintptr_t) p->upage
+                                & ~(FAULT_AROUND_PAGES * PGSIZE - 1));
+  size_t i;
+
+  for (i = 0; i < FAULT_AROUND_PAGES; i++)
+    {
+      struct page *q = page_lookup (start + i * PGSIZE);
+
+      if (q != NULL && q != p && is_text (q)
+          && pagedir_get_page (t->pagedir, q->upage) == NULL
+          && frame_share_text (q))
+        mapped_around_cnt++;
+    }
+}
+
+/* Reads ahead after the running process faulted page P in.  If
+   P directly follows the pages read ahead last time, or a
+   resident page, the process is scanning forward, so up to
+   ra_window of the pages after P are loaded and mapped now,
+   stopping at the first that is missing or already mapped.  The
+   window doubles each time every page read ahead was used and
+   halves when fewer than half were, between 1 and
+   FAULT_AROUND_PAGES pages. */
+static void
+read_ahead (struct page *p)
+{
+  struct thread *t = thread_current ();
+  uint8_t *upage = p->upage;
+  size_t n;
+
+  if (upage == t->ra_next)
+    {
+      /* Count the pages read ahead last time that were used. */
+      size_t cnt = (t->ra_next - t->ra_start) / PGSIZE;
+      size_t used = 0;
+      uint8_t *a;
+
+      frame_lock_acquire ();
+      for (a = t->ra_start; a < t->ra_next; a += PGSIZE)
+        {
+          struct page *q = page_lookup (a);
+          if (q != NULL)
+            {
+              page_save_accessed (q);
+              if (q->clock_ref)
+                used++;
+            }
+        }
+      frame_lock_release ();
+      read_ahead_used_cnt += used;
+
+      if (used == cnt && t->ra_window < FAULT_AROUND_PAGES)
+        t->ra_window *= 2;
+      else if (used * 2 < cnt && t->ra_window > 1)
+        t->ra_window /= 2;
+    }
+  else if (pagedir_get_page (t->pagedir, upage - PGSIZE) == NULL)
+    {
+      /* Not a forward scan. */
+      t->ra_start = t->ra_next = upage + PGSIZE;
+      return;
+    }
+
+  for (n = 0; n < t->ra_window; n++)
+    {
+      struct page *q = page_lookup (upage + (n + 1) * PGSIZE);
+      struct frame *f;
+      bool resident;
+
+      if (q == NULL || pagedir_get_page (t->pagedir, q->upage) != NULL)
+        break;
+      if (!(is_zero (q) && frame_share_zero (q))
+          && !(is_text (q) && frame_share_text (q)))
+        {
+          f = load_page (q, &resident);
+          if (f == NULL)
+            break;
+          frame_unpin (f);
+        }
+      read_ahead_cnt++;
+    }
+  t->ra_start = upage + PGSIZE;
+  t->ra_next = upage + (n + 1) * PGSIZE;
+}
+
+/* If page P's accessed bit is set, clears it and records the
+   access in P's CLOCK_REF and WSS_REF, for the frame table's
+   clock and the working set sampler to find.  The caller must
+   hold the frame table's lock, so that the clock, which may be
+   running in another thread, does not clear the bit between our
+   reading and clearing it. */
+void
+page_save_accessed (struct page *p)
+{
+  uint32_t *pd = p->thread->pagedir;
+
+  ASSERT (frame_lock_held ());
+
+  if (pagedir_is_accessed (pd, p->upage))
+    {
+      p->clock_ref = p->wss_ref = true;
+      pagedir_set_accessed (pd, p->upage, false);
+    }
+}
+
+/* Samples the running process's working set, if WSS_INTERVAL
+   ticks have passed since it was last sampled: counts the pages
+   it accessed since then and averages the count into its
+   estimate.  The walk is done under the frame table's lock,
+   since the clock clears the same bits. */
+static void
+sample_working_set (void)
+{
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+  size_t cnt = 0;
+
+  if (timer_elapsed (t->wss_sampled) < WSS_INTERVAL)
+    return;
+  t->wss_sampled = timer_ticks ();
+
+  frame_lock_acquire ();
+  hash_first (&i, t->pages);
+  while (hash_next (&i))
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, elem);
+
+      page_save_accessed (p);
+      if (p->wss_ref)
+        {
+          cnt++;
+          p->wss_ref = false;
+        }
+    }
+  frame_lock_release ();
+  t->wss = t->wss == SIZE_MAX ? cnt : (t->wss + cnt) / 2;
+}
+
+/* Adds a page to the running thread's supplemental page
+   table. */
+static bool
+page_add (void *upage, struct file *file, off_t ofs, size_t read_bytes,
+          bool writable, bool mmap)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  ASSERT (t->pages != NULL);
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return false;
+  p->thread = t;
+  p->upage = upage;
+  p->writable = writable;
+  p->mmap = mmap;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  p->frame = NULL;
+  p->swap_slot = SWAP_NONE;
+  p->clock_ref = p->wss_ref = false;
+  if (hash_insert (t->pages, &p->elem) != NULL)
+    {
+      free (p);
+      return false;
+    }
+  return true;
+}
+
+/* Prints fault-around statistics. */
+void
+page_print_stats (void)
+{
+  printf ("Fault-around: %lld pages read ahead, %lld used; "
+          "%lld text pages mapped from cache\n",
+          read_ahead_cnt, read_ahead_used_cnt, mapped_around_cnt);
+}
+
+/* Returns true if P is a read-only page of the executable,
+   which processes running the executable can share. */
+static bool
+is_text (const struct page *p)
+{
+  return p->file != NULL && !p->writable && !p->mmap;
+}
+
+/* Returns true if P, which is not mapped, would be filled with
+   zeros if it were loaded now. */
+static bool
+is_zero (const struct page *p)
+{
+  return p->file == NULL && p->swap_slot == SWAP_NONE;
+}
+
+/* Returns a hash value for page P. */
+static unsigned
+page_hash (const struct hash_elem *p_, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (p_, struct page, elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, elem);
+  const struct page *b = hash_entry (b_, struct page, elem);
+  return a->upage < b->upage;
+}
+
+/* Frees page P's record, and the frame or swap slot that holds
+   it. */
+static void
+page_free (struct hash_elem *p_, void *aux UNUSED)
+{
+  struct page *p = hash_entry (p_, struct page, elem);
+  frame_release (p);
+  free (p);
+}
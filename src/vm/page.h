@@ -0,0 +1,69 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct frame;
+struct thread;
+
+/* A page of a user process's virtual address space, as recorded
+   in its supplemental page table.
+
+   The table says where the contents of each page come from.  A
+   page is not given a frame until the process first touches it;
+   page_fault() then calls page_fault_in() to read it from its
+   file or swap, or zero it, and map it.  Pages of memory-mapped
+   files are written back to their file, the rest to swap.  FRAME
+   and SWAP_SLOT are protected by the frame table's lock.
+
+   Both the frame table's clock and the working set sampler need
+   to know whether a page was accessed since they last looked.
+   Whichever of them clears the page's accessed bit first saves
+   it in CLOCK_REF and WSS_REF, so the other still sees it; see
+   page_save_accessed().  CLOCK_REF and WSS_REF are protected by
+   the frame table's lock too. */
+struct page
+  {
+    struct thread *thread;      /* Process the page belongs to. */
+    void *upage;                /* User virtual address. */
+    bool writable;              /* True if the process may write it. */
+    bool mmap;                  /* True if written back to FILE. */
+    struct file *file;          /* File to read from, null to zero-fill. */
+    off_t ofs;                  /* Offset in FILE. */
+    size_t read_bytes;          /* Bytes read from FILE; rest are zero. */
+    struct frame *frame;        /* Frame holding the page, or null. */
+    size_t swap_slot;           /* Swap slot holding it, or SWAP_NONE. */
+    bool clock_ref;             /* Accessed, not yet seen by the clock. */
+    bool wss_ref;               /* Accessed, not yet seen by sampler. */
+    struct list_elem frame_elem; /* Element in frame's `pages' list. */
+    struct hash_elem elem;      /* Element in thread's `pages' table. */
+  };
+
+/* Largest user stack, in pages.  Controlled by kernel
+   command-line option "-sl". */
+extern size_t stack_page_limit;
+
+bool page_table_create (void);
+bool page_table_copy (struct thread *parent);
+void page_table_destroy (void);
+
+bool page_add_file (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes, bool writable);
+bool page_add_zero (void *upage, bool writable);
+bool page_add_mmap (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes);
+void page_remove (void *upage);
+struct page *page_lookup (const void *upage);
+
+bool page_fault_in (const void *fault_addr, bool write);
+bool page_grow_stack (const void *fault_addr, const void *esp);
+bool page_unshare (const void *fault_addr);
+void page_save_accessed (struct page *);
+
+void page_print_stats (void);
+
+#endif /* vm/page.h */
@@ -0,0 +1,450 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/lz.h"
+
+/* Swap space.
+
+   The swap device is divided into page-sized slots, each
+   SECTORS_PER_SLOT sectors long.  A bitmap records which slots
+   are in use.
+
+   In front of the device sits a compressed swap cache in kernel
+   memory.  An evicted page goes there first, compressed, and
+   only goes to the device if it does not compress to ZSWAP_MAX
+   bytes or less, which is as large as malloc() allocates from an
+   arena rather than a whole page.  Zero-filled and otherwise
+   repetitive pages shrink to a few hundred bytes or less, and
+   reading one back costs no disk I/O at all.  The cache's slots
+   are numbered after the device's.  The cache holds at most
+   zswap_limit bytes of compressed data; when a new page does not
+   fit, the pages that have been in the cache longest are written
+   back to the device to make room.  A page written back keeps
+   its cache slot, which then records the device slot that holds
+   it, so that its owner's slot number stays valid.
+
+   swap_lock protects both bitmaps, the cache, and the buffers
+   used to compress.  Once a device slot is allocated, its owner
+   reads and writes it without the lock.  A cache slot is read
+   under the lock, because it may be written back meanwhile.
+   While a page is being written back, its compressed copy stays
+   in the cache slot, so that it can still be read, and if its
+   owner frees the slot, the thread writing it back frees it when
+   it is done. */
+
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A page in the compressed swap cache. */
+struct zpage
+  {
+    struct list_elem elem;      /* Element in zpage_list. */
+    size_t zslot;               /* Index of its cache slot. */
+    size_t size;                /* Bytes of compressed data. */
+    uint8_t data[];             /* Compressed data. */
+  };
+
+/* A slot in the compressed swap cache. */
+struct zslot
+  {
+    struct zpage *z;            /* Compressed page, or null. */
+    size_t disk_slot;           /* If Z is null, where it was written. */
+    bool writing;               /* Being written back now? */
+    bool freed;                 /* Freed while being written back? */
+  };
+
+/* Largest compressed page kept in the cache. */
+#define ZSWAP_MAX (1024 - sizeof (struct zpage))
+
+/* Least compressed size assumed when sizing the cache's slot
+   table: a zero-filled page takes about 100 bytes. */
+#define ZSWAP_MIN 64
+
+/* Most compressed data in the cache, in bytes: 256 kB by
+   default.  Controlled by kernel command-line option "-zl". */
+size_t zswap_limit = 256 * 1024;
+
+static struct block *swap_block;        /* Swap device, if any. */
+static struct bitmap *used_slots;       /* Device slots in use. */
+static size_t disk_slot_cnt;            /* Number of device slots. */
+
+static struct zslot *zslots;            /* Cache slots. */
+static struct bitmap *used_zslots;      /* Cache slots in use. */
+static struct list zpage_list;          /* Cached pages, oldest first. */
+static size_t zswap_bytes;              /* Compressed bytes cached. */
+
+static uint8_t zbuf[ZSWAP_MAX];         /* Compression output. */
+static uint16_t lz_hash[LZ_HASH_SIZE];  /* Compression scratch. */
+
+static struct lock swap_lock;           /* Protects all the above. */
+
+/* Statistics. */
+static long long zswap_out_cnt;         /* Pages compressed into cache. */
+static long long zswap_out_bytes;       /* Their compressed size. */
+static long long zswap_in_cnt;          /* Pages read back from cache. */
+static long long zswap_wb_cnt;          /* Pages written back from it. */
+static long long disk_out_cnt;          /* Pages written to device. */
+static long long disk_in_cnt;           /* Pages read from device. */
+
+static size_t zswap_out (const void *kpage);
+static size_t zswap_add (struct zpage *);
+static bool zswap_write_back (void);
+static size_t disk_out (const void *kpage);
+static void disk_read (size_t slot, void *kpage);
+static void disk_write (size_t slot, const void *kpage);
+static bool is_zslot (size_t slot);
+
+/* Finds the swap device, if there is one, and sets up its slot
+   bitmap, and sets up the compressed swap cache.  Without a
+   swap device, swap_out() fails once the cache is full. */
+void
+swap_init (void)
+{
+  size_t zslot_cnt;
+
+  lock_init (&swap_lock);
+
+  zslot_cnt = zswap_limit / ZSWAP_MIN;
+  zslots = calloc (zslot_cnt, sizeof *zslots);
+  used_zslots = bitmap_create (zslot_cnt);
+  if ((zslot_cnt > 0 && zslots == NULL) || used_zslots == NULL)
+    PANIC ("swap cache creation failed");
+  list_init (&zpage_list);
+
+  swap_block = block_get_role (BLOCK_SWAP);
+  if (swap_block == NULL)
+    return;
+
+  disk_slot_cnt = block_size (swap_block) / SECTORS_PER_SLOT;
+  used_slots = bitmap_create (disk_slot_cnt);
+  if (used_slots == NULL)
+    PANIC ("swap bitmap creation failed");
+  printf ("swap: %zu slots on %s\n", disk_slot_cnt, block_name (swap_block));
+}
+
+/* Writes the page at KPAGE to a free swap slot, in the cache if
+   possible, and returns the slot, or SWAP_NONE if swap is full. */
+size_t
+swap_out (const void *kpage)
+{
+  size_t slot = zswap_out (kpage);
+
+  if (slot == SWAP_NONE)
+    slot = disk_out (kpage);
+  return slot;
+}
+
+/* Reads swap slot SLOT into the page at KPAGE and frees the
+   slot. */
+void
+swap_in (size_t slot, void *kpage)
+{
+  ASSERT (slot != SWAP_NONE);
+
+  if (is_zslot (slot))
+    {
+      struct zslot *s = &zslots[slot - disk_slot_cnt];
+      size_t disk_slot = SWAP_NONE;
+
+      lock_acquire (&swap_lock);
+      if (s->z != NULL)
+        {
+          lz_decompress (s->z->data, s->z->size, kpage, PGSIZE);
+          zswap_in_cnt++;
+        }
+      else
+        disk_slot = s->disk_slot;
+      lock_release (&swap_lock);
+      if (disk_slot != SWAP_NONE)
+        disk_read (disk_slot, kpage);
+    }
+  else
+    disk_read (slot, kpage);
+  swap_free (slot);
+}
+
+/* Copies swap slot SLOT to a free slot and returns the new slot,
+   or SWAP_NONE if swap is full. */
+size_t
+swap_copy (size_t slot)
+{
+  uint8_t buffer[BLOCK_SECTOR_SIZE];
+  size_t copy, i;
+
+  ASSERT (slot != SWAP_NONE);
+
+  if (is_zslot (slot))
+    {
+      struct zslot *s = &zslots[slot - disk_slot_cnt];
+      struct zpage *z, *zcopy;
+      void *kpage = NULL;
+
+      lock_acquire (&swap_lock);
+      z = s->z;
+      if (z != NULL)
+        {
+          /* Copy the compressed page within the cache, if there
+             is room... */
+          copy = SWAP_NONE;
+          if (zswap_bytes + z->size <= zswap_limit
+              && (zcopy = malloc (sizeof *zcopy + z->size)) != NULL)
+            {
+              zcopy->size = z->size;
+              memcpy (zcopy->data, z->data, z->size);
+              copy = zswap_add (zcopy);
+              if (copy == SWAP_NONE)
+                free (zcopy);
+            }
+
+          /* ...or write it out to the device. */
+          if (copy == SWAP_NONE)
+            {
+              kpage = palloc_get_page (0);
+              if (kpage != NULL)
+                lz_decompress (z->data, z->size, kpage, PGSIZE);
+            }
+          lock_release (&swap_lock);
+          if (kpage != NULL)
+            {
+              copy = disk_out (kpage);
+              palloc_free_page (kpage);
+            }
+          return copy;
+        }
+
+      /* The page was written back to the device.  Copy the device
+         slot that holds it. */
+      slot = s->disk_slot;
+      lock_release (&swap_lock);
+    }
+
+  lock_acquire (&swap_lock);
+  copy = bitmap_scan_and_flip (used_slots, 0, 1, false);
+  lock_release (&swap_lock);
+  if (copy == BITMAP_ERROR)
+    return SWAP_NONE;
+
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    {
+      block_read (swap_block, slot * SECTORS_PER_SLOT + i, buffer);
+      block_write (swap_block, copy * SECTORS_PER_SLOT + i, buffer);
+    }
+  return copy;
+}
+
+/* Frees swap slot SLOT without reading it. */
+void
+swap_free (size_t slot)
+{
+  ASSERT (slot != SWAP_NONE);
+
+  lock_acquire (&swap_lock);
+  if (is_zslot (slot))
+    {
+      size_t i = slot - disk_slot_cnt;
+      struct zslot *s = &zslots[i];
+
+      ASSERT (bitmap_test (used_zslots, i));
+      if (s->writing)
+        s->freed = true;
+      else
+        {
+          if (s->z != NULL)
+            {
+              list_remove (&s->z->elem);
+              zswap_bytes -= s->z->size;
+              free (s->z);
+              s->z = NULL;
+            }
+          else
+            bitmap_reset (used_slots, s->disk_slot);
+          bitmap_reset (used_zslots, i);
+        }
+    }
+  else
+    {
+      ASSERT (bitmap_test (used_slots, slot));
+      bitmap_reset (used_slots, slot);
+    }
+  lock_release (&swap_lock);
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  printf ("Swap: %lld pages compressed to %lld bytes, %lld read back, "
+          "%lld written back; %lld pages written to disk, %lld read\n",
+          zswap_out_cnt, zswap_out_bytes, zswap_in_cnt, zswap_wb_cnt,
+          disk_out_cnt, disk_in_cnt);
+}
+
+/* Compresses the page at KPAGE into a free slot in the swap
+   cache, writing the oldest cached pages back to the device if
+   that is needed to make room, and returns the slot, or
+   SWAP_NONE if the page compresses poorly or there is no room. */
+static size_t
+zswap_out (const void *kpage)
+{
+  struct zpage *z;
+  size_t size;
+  size_t slot = SWAP_NONE;
+
+  lock_acquire (&swap_lock);
+  size = lz_compress (kpage, PGSIZE, zbuf, ZSWAP_MAX, lz_hash);
+  if (size > 0 && size <= zswap_limit
+      && (z = malloc (sizeof *z + size)) != NULL)
+    {
+      z->size = size;
+      memcpy (z->data, zbuf, size);
+      while (zswap_bytes + size > zswap_limit && zswap_write_back ())
+        continue;
+      if (zswap_bytes + size <= zswap_limit)
+        slot = zswap_add (z);
+      if (slot != SWAP_NONE)
+        {
+          zswap_out_cnt++;
+          zswap_out_bytes += size;
+        }
+      else
+        free (z);
+    }
+  lock_release (&swap_lock);
+
+  return slot;
+}
+
+/* Puts compressed page Z in a free cache slot, as the newest
+   page in the cache, and returns the slot, or SWAP_NONE if no
+   cache slot is free.  swap_lock must be held. */
+static size_t
+zswap_add (struct zpage *z)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&swap_lock));
+
+  i = bitmap_scan_and_flip (used_zslots, 0, 1, false);
+  if (i == BITMAP_ERROR)
+    return SWAP_NONE;
+  z->zslot = i;
+  zslots[i].z = z;
+  zslots[i].writing = zslots[i].freed = false;
+  list_push_back (&zpage_list, &z->elem);
+  zswap_bytes += z->size;
+  return disk_slot_cnt + i;
+}
+
+/* Writes the page that has been in the swap cache longest back
+   to a free slot on the device, taking it out of the cache.
+   Returns true if successful, false if the cache is empty or the
+   device is full or missing.  swap_lock must be held; it is
+   released during the write. */
+static bool
+zswap_write_back (void)
+{
+  struct zpage *z;
+  struct zslot *s;
+  size_t disk_slot;
+  void *kpage;
+
+  ASSERT (lock_held_by_current_thread (&swap_lock));
+
+  if (list_empty (&zpage_list) || swap_block == NULL)
+    return false;
+  disk_slot = bitmap_scan_and_flip (used_slots, 0, 1, false);
+  if (disk_slot == BITMAP_ERROR)
+    return false;
+  kpage = palloc_get_page (0);
+  if (kpage == NULL)
+    {
+      bitmap_reset (used_slots, disk_slot);
+      return false;
+    }
+
+  /* Take the page out of the cache's accounting, but leave it in
+     its slot, so that it can still be read during the write. */
+  z = list_entry (list_pop_front (&zpage_list), struct zpage, elem);
+  s = &zslots[z->zslot];
+  s->writing = true;
+  zswap_bytes -= z->size;
+  lz_decompress (z->data, z->size, kpage, PGSIZE);
+
+  lock_release (&swap_lock);
+  disk_write (disk_slot, kpage);
+  palloc_free_page (kpage);
+  lock_acquire (&swap_lock);
+
+  s->writing = false;
+  s->z = NULL;
+  s->disk_slot = disk_slot;
+  if (s->freed)
+    {
+      bitmap_reset (used_slots, disk_slot);
+      bitmap_reset (used_zslots, z->zslot);
+    }
+  free (z);
+  zswap_wb_cnt++;
+  return true;
+}
+
+/* Writes the page at KPAGE to a free slot on the swap device and
+   returns the slot, or SWAP_NONE if the device is full or there
+   is none. */
+static size_t
+disk_out (const void *kpage)
+{
+  size_t slot;
+
+  if (swap_block == NULL)
+    return SWAP_NONE;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (used_slots, 0, 1, false);
+  if (slot != BITMAP_ERROR)
+    disk_out_cnt++;
+  lock_release (&swap_lock);
+  if (slot == BITMAP_ERROR)
+    return SWAP_NONE;
+
+  disk_write (slot, kpage);
+  return slot;
+}
+
+/* Reads device slot SLOT into the page at KPAGE. */
+static void
+disk_read (size_t slot, void *kpage)
+{
+  size_t i;
+
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_read (swap_block, slot * SECTORS_PER_SLOT + i,
+                (uint8_t *) kpage + i * BLOCK_SECTOR_SIZE);
+  disk_in_cnt++;
+}
+
+/* Writes the page at KPAGE to device slot SLOT. */
+static void
+disk_write (size_t slot, const void *kpage)
+{
+  size_t i;
+
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_write (swap_block, slot * SECTORS_PER_SLOT + i,
+                 (const uint8_t *) kpage + i * BLOCK_SECTOR_SIZE);
+}
+
+/* Returns true if SLOT is in the compressed swap cache, false if
+   it is on the swap device. */
+static bool
+is_zslot (size_t slot)
+{
+  return slot >= disk_slot_cnt;
+}
@@ -0,0 +1,21 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Swap slot that holds nothing. */
+#define SWAP_NONE SIZE_MAX
+
+/* Most compressed data kept in memory, in bytes.  Controlled by
+   kernel command-line option "-zl". */
+extern size_t zswap_limit;
+
+void swap_init (void);
+size_t swap_out (const void *kpage);
+void swap_in (size_t slot, void *kpage);
+size_t swap_copy (size_t slot);
+void swap_free (size_t slot);
+void swap_print_stats (void);
+
+#endif /* vm/swap.h */